@@ -5,7 +5,9 @@
 #include <bitset>
 #include <assert.h>
 #include <algorithm>
+#include <mutex>
 #include "nodes.hpp"
+#include "flat_tree.hpp"
 #include "definitions.hpp"
 #include "card_abstraction.hpp"
 #include "action_abstraction.hpp"
@@ -21,6 +23,10 @@ protected:
   const Game *game;
   INode *game_tree;
   INode *public_tree;
+  // the best responses of the monitor and of checkpoints can ask for the
+  // public tree at the same time, it is built by the first of them.
+  std::once_flag public_tree_once;
+  FlatTree flat_tree;
   CardAbstraction *card_abs;
   ActionAbstraction *action_abs;
 
@@ -31,6 +37,9 @@ public:
 
   virtual ~AbstractGame();
   virtual void evaluate(hand_t &hand) = 0;
+  // showdown strength of hole with the full board, the stronger hand wins
+  // and equal strengths split.
+  virtual int hand_strength(const card_c &hole, const card_c &board) = 0;
 
   uint64_t get_nb_infosets() { return nb_infosets; }
   const Game *get_gamedef() { return game; }
@@ -133,30 +142,68 @@ public:
                           bool deal_board = false);
 
   INode *game_tree_root();
+  // the game tree as one array, used by the samplers.
+  const FlatTree &flat_game_tree() { return flat_tree; }
+  // indexes the action sequences of the flat tree for FlatTree::advance.
+  void index_action_sequences() { flat_tree.build_sequence_index(); }
   INode *public_tree_root();
 
   void print_gamedef();
 };
 
-class KuhnGame : public AbstractGame {
+class KuhnGame final : public AbstractGame {
 
 public:
   KuhnGame(const Game *game_definition, CardAbstraction *cabs,
            ActionAbstraction *aabs, int nb_threads = 1);
 
-  virtual void evaluate(hand_t &hand);
+  virtual void evaluate(hand_t &hand) {
+    hand.value[0] =
+        rankOfCard(hand.holes[0][0]) > rankOfCard(hand.holes[1][0]) ? 1 : -1;
+    hand.value[1] = hand.value[0] * -1;
+  }
+
+  virtual int hand_strength(const card_c &hole, const card_c &board) {
+    return rankOfCard(hole[0]);
+  }
 };
 
-class LeducGame : public AbstractGame {
+class LeducGame final : public AbstractGame {
 public:
   LeducGame(const Game *game_definition, CardAbstraction *cabs,
             ActionAbstraction *aabs, int nb_threads = 1);
 
-  virtual void evaluate(hand_t &hand);
-  int rank_hand(int hand, int board);
+  virtual void evaluate(hand_t &hand) {
+    int p1r = rank_hand(hand.holes[0][0], hand.board[0]);
+    int p2r = rank_hand(hand.holes[1][0], hand.board[0]);
+
+    if (p1r > p2r) {
+      hand.value[0] = 1;
+      hand.value[1] = -1;
+    } else if (p1r < p2r) {
+      hand.value[0] = -1;
+      hand.value[1] = 1;
+    } else {
+      hand.value[0] = 0;
+      hand.value[1] = 0;
+    }
+  }
+
+  virtual int hand_strength(const card_c &hole, const card_c &board) {
+    return rank_hand(hole[0], board[0]);
+  }
+
+  int rank_hand(int hand, int board) {
+    int h = rankOfCard(hand);
+    int b = rankOfCard(board);
+
+    if (h == b)
+      return 100;
+    return h;
+  }
 };
 
-class HoldemGame : public AbstractGame {
+class HoldemGame final : public AbstractGame {
   ecalc::Handranks *handranks;
 
 public:
@@ -164,6 +211,7 @@ public:
              ActionAbstraction *aabs, ecalc::Handranks *hr, int nb_threads = 1);
 
   virtual void evaluate(hand_t &hand);
+  virtual int hand_strength(const card_c &hole, const card_c &board);
 };
 
 #endif
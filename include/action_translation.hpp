@@ -40,6 +40,11 @@ public:
   }
 
   virtual size_t map_rand(std::vector<double> &abs_actions, double x) {
+    return map_dart(abs_actions, x, ((double)rand()) / RAND_MAX);
+  }
+
+  // map_rand with the uniform number dart in [0, 1) drawn by the caller.
+  size_t map_dart(std::vector<double> &abs_actions, double x, double dart) {
     double a, b, x_median, f_ab_x;
     unsigned lower_bound, upper_bound, num_actions;
     num_actions = abs_actions.size();
@@ -62,7 +67,6 @@ public:
       //printf("f/x* = %f, f*/b = %f\n",a/f_ab_x,f_ab_x/b);
 
       double weights[] = {f_ab_x, 1-f_ab_x};
-      double dart =((double)rand())/RAND_MAX; 
       //printf("dart = %f\n",dart);
       unsigned choice;
       for(choice = 0; choice < 2; ++choice){
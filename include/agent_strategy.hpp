@@ -0,0 +1,69 @@
+#ifndef AGENT_STRATEGY_HPP
+#define AGENT_STRATEGY_HPP
+
+#include <string>
+#include <vector>
+#include "definitions.hpp"
+#include "flat_tree.hpp"
+
+class AbstractGame;
+class CardAbstraction;
+class CFRM;
+class Policy;
+class Bundle;
+
+// the strategy an agent plays: a mapped policy, or the average strategy of
+// a checkpoint, over the flat tree of the game or of a bundle. lookups are
+// read only and may run in parallel.
+class AgentStrategy {
+  const Game *gamedef;
+  const FlatTree *tree;
+  CardAbstraction *card_abs;
+  CFRM *cfr;
+  // the policy the agent plays and the one it owns, if any.
+  const Policy *policy;
+  Policy *own_policy;
+
+public:
+  // loads filename, a policy or any checkpoint of game. builds the action
+  // sequence index of the tree.
+  AgentStrategy(AbstractGame *game, const std::string &filename);
+  // plays the policy of bundle, which must outlive the agent. card_abs is
+  // the abstraction of the bundle.
+  AgentStrategy(const Bundle &bundle, CardAbstraction *card_abs);
+  ~AgentStrategy();
+
+  AgentStrategy(const AgentStrategy &) = delete;
+  AgentStrategy &operator=(const AgentStrategy &) = delete;
+
+  // the played policy, NULL if a checkpoint was loaded.
+  const Policy *get_policy() const { return policy; }
+  // the loaded checkpoint, NULL if a policy is played.
+  CFRM *get_cfr() const { return cfr; }
+  const FlatTree &get_tree() const { return *tree; }
+
+  // information set node of the acting player in state, FlatTree::NO_NODE
+  // if the state left the tree. cursor continues from the previous lookup
+  // of the same hand, raises that are not in the tree are translated with
+  // numbers of rng.
+  uint32_t lookup(const MatchState &state, tree_cursor_t &cursor,
+                  nbgen &rng) const {
+    return tree->advance(cursor, &state.state, rng);
+  }
+
+  unsigned nb_actions(uint32_t node) const {
+    return tree->nodes[node].nb_children;
+  }
+  const Action &action(uint32_t node, unsigned i) const {
+    return tree->actions[tree->nodes[node].first_child + i];
+  }
+
+  // normalized strategy at node for the cards the viewing player of state
+  // sees. one probability per action of node.
+  std::vector<double> strategy(uint32_t node, const MatchState &state) const;
+  // strategy at node for a player holding hand with board in round.
+  std::vector<double> strategy(uint32_t node, const card_c &hand,
+                               const card_c &board, int round) const;
+};
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+#include <cstddef>
+
+// number of heap allocations made by the calling thread. only counted when
+// built with COUNT_ALLOCATIONS (target=debug), otherwise always 0.
+size_t thread_allocations();
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef BOARD_RANKER_HPP
+#define BOARD_RANKER_HPP
+
+#include <cstdint>
+#include <ecalc/handranks.hpp>
+#include "definitions.hpp"
+
+// ranks hands on one full board. the board is added once and the hole cards
+// of every hand on top, with the handranks table or the acpc evaluator.
+class BoardRanker {
+  const ecalc::Handranks *handranks;
+  int nb_hole_cards;
+  // table state after the board cards.
+  int table_state;
+  // acpc cardset of the board.
+  uint64_t board;
+
+public:
+  BoardRanker(const ecalc::Handranks *handranks, const uint8_t *cards,
+              int nb_board_cards, int nb_hole_cards);
+
+  // rank of hole on the board, higher ranks win.
+  int operator()(const uint8_t *hole) const;
+};
+
+// true if hand holds one of the n cards.
+bool holds_card(const card_c &hand, const uint8_t *cards, int n);
+
+#endif
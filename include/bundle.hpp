@@ -0,0 +1,106 @@
+#ifndef BUNDLE_HPP
+#define BUNDLE_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "definitions.hpp"
+#include "flat_tree.hpp"
+
+class CardAbstraction;
+class ClusterCardAbstraction;
+class Policy;
+
+// on disk format of a bundle, everything the player needs to act in one
+// file that is mapped at startup instead of building the game tree and
+// loading the card abstraction and strategy.
+//
+//   header     bundle_header_t, padded to CHECKPOINT_ALIGNMENT
+//   nodes      FlatNode of every node of the flat game tree, padded
+//   actions    Action leading to every node, padded
+//   sequences  the sequence index of the tree, padded
+//   tables     only for cluster abstractions: the bucket of every hand
+//              index per round as uint32_t, every table padded
+//   policy     a policy file, see policy.hpp
+//
+// the arrays are stored as they are in memory, a bundle can only be read
+// on machines with the same byte order and struct layout.
+
+const char BUNDLE_MAGIC[8] = {'C', 'F', 'R', 'M', 'B', 'N', 'D', 'L'};
+const uint32_t BUNDLE_VERSION = 1;
+
+struct bundle_header_t {
+  char magic[8];
+  uint32_t version;
+  // card_abstraction the strategy was computed with.
+  uint32_t card_abs;
+  char card_abs_param[256];
+  // layout_fingerprint of the strategy.
+  uint64_t fingerprint;
+  // the game definition, so the player does not need the game file.
+  Game game;
+  uint64_t nb_nodes;
+  uint64_t nodes_offset;
+  uint64_t actions_offset;
+  uint64_t nb_sequence_slots;
+  uint64_t sequences_offset;
+  // zero for abstractions without tables.
+  int32_t nb_buckets[MAX_ROUNDS];
+  uint64_t table_size[MAX_ROUNDS];
+  uint64_t table_offset[MAX_ROUNDS];
+  uint64_t policy_offset;
+  uint64_t policy_bytes;
+  // checksum of the tree, the sequence index and the tables.
+  uint64_t checksum;
+};
+
+// true if filename starts with the bundle magic.
+bool is_bundle(const std::string &filename);
+
+// writes the flat tree of a game, the bucket tables of card_abs if it is a
+// cluster abstraction and the average strategy as a policy (see
+// write_policy) to filename. tree must have a sequence index.
+void write_bundle(const std::string &filename, const Game *game,
+                  card_abstraction card_abs_type,
+                  const std::string &card_abs_param, CardAbstraction *card_abs,
+                  const FlatTree &tree, const entry_c &avg_strategy,
+                  unsigned bits, const std::vector<double> &reach,
+                  double threshold);
+
+// read only mapping of a bundle. nothing is read at construction apart from
+// the header and the policy index, pages are loaded as they are used.
+class Bundle {
+  bundle_header_t header;
+  void *mapping;
+  size_t mapped_bytes;
+  FlatTree flat_tree;
+  std::unique_ptr<Policy> mapped_policy;
+  std::unique_ptr<ClusterCardAbstraction> cluster;
+
+public:
+  // maps filename. throws if it is not a valid bundle.
+  Bundle(const std::string &filename);
+  ~Bundle();
+
+  Bundle(const Bundle &) = delete;
+  Bundle &operator=(const Bundle &) = delete;
+
+  const bundle_header_t &get_header() const { return header; }
+  const Game *get_gamedef() const { return &header.game; }
+  const FlatTree &tree() const { return flat_tree; }
+  const Policy &policy() const { return *mapped_policy; }
+  size_t bytes() const { return mapped_bytes; }
+
+  card_abstraction get_card_abs() const {
+    return (card_abstraction)header.card_abs;
+  }
+  std::string get_card_abs_param() const { return header.card_abs_param; }
+  // the abstraction over the mapped tables of a cluster abstraction, NULL
+  // for the other abstractions, which are cheap to construct.
+  CardAbstraction *cluster_abstraction() const;
+
+  // true if the checksums of all sections match. reads the whole bundle.
+  bool verify() const;
+};
+
+#endif
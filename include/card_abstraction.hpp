@@ -18,10 +18,23 @@ using std::string;
 class CardAbstraction {
 public:
   virtual unsigned get_nb_buckets(const Game *game, int round) = 0;
-  virtual int map_hand_to_bucket(card_c hand, card_c board, int round) = 0;
+  virtual int map_hand_to_bucket(const uint8_t *hand, const uint8_t *board,
+                                 int round) = 0;
+
+  int map_hand_to_bucket(const card_c &hand, const card_c &board, int round) {
+    return map_hand_to_bucket(hand.data(), board.data(), round);
+  }
+
+  // writes the buckets of hand in rounds 0 to nb_rounds-1 into buckets.
+  // abstractions that can reuse work between rounds override this.
+  virtual void map_hand_to_buckets(const uint8_t *hand, const uint8_t *board,
+                                   int nb_rounds, int *buckets) {
+    for (int r = 0; r < nb_rounds; ++r)
+      buckets[r] = map_hand_to_bucket(hand, board, r);
+  }
 };
 
-class NullCardAbstraction : public CardAbstraction {
+class NullCardAbstraction final : public CardAbstraction {
   const int deck_size;
   const Game *game;
   std::vector<unsigned> nb_buckets;
@@ -49,7 +62,9 @@ public:
     return nb_buckets[round];
   }
 
-  virtual int map_hand_to_bucket(card_c hand, card_c board, int round) {
+  using CardAbstraction::map_hand_to_bucket;
+  virtual int map_hand_to_bucket(const uint8_t *hand, const uint8_t *board,
+                                 int round) {
     int bucket = 0;
     for (int i = 0; i < game->numHoleCards; ++i) {
       if (i > 0) {
@@ -68,24 +83,56 @@ public:
     }
     return bucket;
   }
+
+  // the bucket of a round extends the bucket of the previous round.
+  virtual void map_hand_to_buckets(const uint8_t *hand, const uint8_t *board,
+                                   int nb_rounds, int *buckets) {
+    int bucket = map_hand_to_bucket(hand, board, 0);
+    buckets[0] = bucket;
+    for (int r = 1; r < nb_rounds; ++r) {
+      for (int i = bcStart(game, r); i < sumBoardCards(game, r); ++i) {
+        bucket *= deck_size;
+        uint8_t card = board[i];
+        bucket += rankOfCard(card) * game->numSuits + suitOfCard(card);
+      }
+      buckets[r] = bucket;
+    }
+  }
 };
 
-class BlindCardAbstraction : public CardAbstraction {
+class BlindCardAbstraction final : public CardAbstraction {
 public:
   BlindCardAbstraction(const Game *game, string param) {}
   virtual unsigned get_nb_buckets(const Game *game, int round) { return 1; }
-  virtual int map_hand_to_bucket(card_c hand, card_c board, int round) {
+  using CardAbstraction::map_hand_to_bucket;
+  virtual int map_hand_to_bucket(const uint8_t *hand, const uint8_t *board,
+                                 int round) {
     return 0;
   }
+
+  virtual void map_hand_to_buckets(const uint8_t *hand, const uint8_t *board,
+                                   int nb_rounds, int *buckets) {
+    std::fill(buckets, buckets + nb_rounds, 0);
+  }
 };
 
-class ClusterCardAbstraction : public CardAbstraction {
+class ClusterCardAbstraction final : public CardAbstraction {
   struct hand_feature {
     double value;
     unsigned cluster;
   };
   std::vector<ecalc::ECalc *> calc;
   hand_indexer_t indexer[4];
+  // bucket of every hand index of a round. points into buckets, or into a
+  // bundle the tables were mapped from.
+  const unsigned *table[4];
+
+  void init_indexers() {
+    assert(hand_indexer_init(1, (uint8_t[]) {2}, &indexer[0]));
+    assert(hand_indexer_init(2, (uint8_t[]) {2, 3}, &indexer[1]));
+    assert(hand_indexer_init(2, (uint8_t[]) {2, 4}, &indexer[2]));
+    assert(hand_indexer_init(2, (uint8_t[]) {2, 5}, &indexer[3]));
+  }
 
 public:
   int_c nb_buckets;
@@ -97,13 +144,26 @@ public:
     init(game->numRounds, param);
   }
 
+  // abstraction over tables of table_size(r) buckets per round r that are
+  // kept elsewhere, e.g. in a mapped bundle.
+  ClusterCardAbstraction(int nb_rounds, const int *round_buckets,
+                         const unsigned *const *tables)
+      : nb_buckets(round_buckets, round_buckets + nb_rounds) {
+    init_indexers();
+    for (int r = 0; r < nb_rounds; ++r)
+      table[r] = tables[r];
+  }
+
+  // number of hand indices of round.
+  size_t table_size(int round) const {
+    return indexer[round].round_size[round == 0 ? 0 : 1];
+  }
+  const unsigned *bucket_table(int round) const { return table[round]; }
+
   void init(int nb_rounds, string load_from) {
     this->nb_buckets = int_c(nb_rounds);
     this->buckets = std::vector<std::vector<unsigned>>(nb_rounds);
-    assert(hand_indexer_init(1, (uint8_t[]) {2}, &indexer[0]));
-    assert(hand_indexer_init(2, (uint8_t[]) {2, 3}, &indexer[1]));
-    assert(hand_indexer_init(2, (uint8_t[]) {2, 4}, &indexer[2]));
-    assert(hand_indexer_init(2, (uint8_t[]) {2, 5}, &indexer[3]));
+    init_indexers();
 
     std::ifstream file(load_from.c_str(), std::ios::in | std::ios::binary);
 
@@ -119,6 +179,8 @@ public:
                   sizeof(buckets[round][j]));
       }
     }
+    for (int r = 0; r < nb_rounds; ++r)
+      table[r] = buckets[r].data();
   }
 
   ~ClusterCardAbstraction() {}
@@ -127,15 +189,34 @@ public:
     return nb_buckets[round];
   }
 
-  virtual int map_hand_to_bucket(card_c hand, card_c board, int round) {
+  using CardAbstraction::map_hand_to_bucket;
+  virtual int map_hand_to_bucket(const uint8_t *hand, const uint8_t *board,
+                                 int round) {
     uint8_t cards[7];
-    for (unsigned i = 0; i < hand.size(); ++i)
-      cards[i] = hand[i];
-    for (unsigned i = 2; i < board.size() + 2; ++i)
-      cards[i] = board[i - 2];
+    unsigned nb_board = round == 0 ? 0 : indexer[round].cards_per_round[1];
+    cards[0] = hand[0];
+    cards[1] = hand[1];
+    for (unsigned i = 0; i < nb_board; ++i)
+      cards[i + 2] = board[i];
 
     hand_index_t index = hand_index_last(&indexer[round], cards);
-    return buckets[round][index];
+    return table[round][index];
+  }
+
+  // every round has its own indexer, but the cards only have to be gathered
+  // once. the board of a round is a prefix of the full board.
+  virtual void map_hand_to_buckets(const uint8_t *hand, const uint8_t *board,
+                                   int nb_rounds, int *bucket_out) {
+    uint8_t cards[7];
+    cards[0] = hand[0];
+    cards[1] = hand[1];
+    unsigned nb_board =
+        nb_rounds > 1 ? indexer[nb_rounds - 1].cards_per_round[1] : 0;
+    for (unsigned i = 0; i < nb_board; ++i)
+      cards[i + 2] = board[i];
+
+    for (int r = 0; r < nb_rounds; ++r)
+      bucket_out[r] = table[r][hand_index_last(&indexer[r], cards)];
   }
 };
 
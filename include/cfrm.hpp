@@ -2,12 +2,21 @@
 #define CFRM_HPP
 
 #include <random>
+#include <cmath>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
 #include <bitset>
 #include <string>
 #include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <poker/card.hpp>
 #include <ecalc/types.hpp>
 #include <ecalc/macros.hpp>
@@ -15,37 +24,157 @@
 
 using std::vector;
 
+// hands that can still be dealt with one deck of the public tree, shared by
+// all public tree nodes with that deck.
+struct br_board_t {
+  hand_list hands;
+  // position in hands by CFRM::br_hand_key, -1 if a card of the hand is dead.
+  vector<int> index;
+  // number of hands holding each card.
+  vector<unsigned> card_count;
+  // bucket of every hand in the round of the board, empty if no information
+  // set has the deck.
+  vector<int> buckets;
+  // showdown strength of every hand and the hands by ascending strength,
+  // empty if no showdown has the deck.
+  vector<int> strength;
+  vector<unsigned> order;
+};
+
+// buffers of the best response at one depth of the public tree: the reach
+// and values passed to the children and the strategy of the hands.
+struct br_frame_t {
+  vector<double> reach[2];
+  vector<double> values[2];
+  vector<double> strategy;
+  // position of the hands of a dealt board before the deal.
+  vector<unsigned> hand_idx;
+};
+
+struct br_pool_t;
+
+// buffers of one best response thread.
+struct br_workspace_t {
+  vector<br_frame_t> frames;
+  vector<double> card_reach;
+  // values of the boards a pool thread evaluated.
+  vector<double> sums[2];
+  // threads that split the boards of the public chance nodes, NULL within a
+  // thread of the pool.
+  br_pool_t *pool = NULL;
+};
+
+// threads of one best response, started once and reused by every public
+// chance node that splits its boards.
+struct br_pool_t {
+  vector<br_workspace_t> workspaces;
+
+  br_pool_t(unsigned nb_threads, unsigned depth);
+  ~br_pool_t();
+
+  // calls job with the index of every thread and returns once all are done.
+  void run(const std::function<void(unsigned)> &job);
+
+private:
+  vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable cv;
+  const std::function<void(unsigned)> *job = NULL;
+  // increased for every job, a thread runs each generation once.
+  uint64_t generation = 0;
+  unsigned nb_running = 0;
+  bool stop = false;
+};
+
 class CFRM {
 public:
   AbstractGame *game;
+  const FlatTree &tree;
   entry_c regrets;
   entry_c avg_strategy;
+  card_c deck;
+  update_mode mode = HOGWILD_UPDATE;
+  compression_t compression = NO_COMPRESSION;
 
   CFRM(AbstractGame *game)
-      : game(game), regrets(game->get_nb_infosets()),
-        avg_strategy(game->get_nb_infosets()) {
+      : game(game), tree(game->flat_game_tree()),
+        regrets(game->get_nb_infosets()),
+        avg_strategy(game->get_nb_infosets()),
+        deck(game->generate_deck(game->get_gamedef()->numRanks,
+                                 game->get_gamedef()->numSuits)) {
     game->game_tree_root()->init_entries(
         regrets, avg_strategy, game->get_gamedef(), game->card_abstraction());
+    regrets.allocate();
+    avg_strategy.allocate();
   }
 
   CFRM(AbstractGame *game, char *strat_dump_file);
 
-  INode *lookup_state(const State *state, int player);
+  INode *lookup_state(const State *state, int player, nbgen &rng);
 
+  // deals a hand and fills in its buckets and showdown values.
   hand_t generate_hand(nbgen &rng);
 
-  int draw_card(uint64_t &deckset, card_c deck, int deck_size, nbgen &rng);
+  // generate_hand with the concrete game and card abstraction known at
+  // compile time, so bucketing and evaluation are not dispatched virtually.
+  template <class G, class A> hand_t generate_hand(nbgen &rng) {
+    hand_t hand;
+    draw_hand(hand, rng);
+
+    A *abs = static_cast<A *>(game->card_abstraction());
+    for (int p = 0; p < game->nb_players(); ++p)
+      abs->A::map_hand_to_buckets(hand.holes[p], hand.board,
+                                  game->nb_rounds(), hand.buckets[p]);
+
+    static_cast<G *>(game)->G::evaluate(hand);
+    return hand;
+  }
+
+  // deals the hole and board cards of hand.
+  void draw_hand(hand_t &hand, nbgen &rng);
+
+  int draw_card(uint64_t &deckset, const card_c &deck, int deck_size,
+                nbgen &rng);
 
   void print_strategy(unsigned player);
 
   void print_strategy_r(unsigned player, INode *curr_node,
                         std::string );
 
-  std::vector<double> get_strategy(uint64_t info_idx, int bucket);
+  // writes the current regret matching strategy of bucket into strategy,
+  // which has to hold MAX_ABSTRACT_ACTIONS values. returns the number of
+  // actions.
+  unsigned get_strategy(uint64_t info_idx, int bucket, double *strategy);
+
+  int sample_strategy(const double *strategy, unsigned nb_choices, nbgen &rng);
 
-  int sample_strategy(std::vector<double> strategy, nbgen &rng);
+  // hints the cache to load the regret row hand reads at node.
+  void prefetch_row(const FlatNode *node, const hand_t &hand) const {
+    if (node->type == FLAT_INFOSET)
+      __builtin_prefetch(regrets[node->info_idx].row(
+          hand.buckets[node->player][node->round]));
+  }
+
+  // adds values to the nb_entries values of row. concurrent updates are
+  // synchronized according to mode. with floor set the updated values are
+  // clipped at zero (regret matching+).
+  void update_row(entry_value_t *row, const double *values,
+                  unsigned nb_entries, bool floor = false);
+
+  // flags the regions holding the values as changed for delta checkpoints.
+  void mark_dirty(const entry_value_t *first, unsigned n) {
+    if (!regrets.mark_dirty(first, n))
+      avg_strategy.mark_dirty(first, n);
+  }
+
+  // merges the delta buffer of the calling thread into the tables. has to be
+  // called by every training thread before the tables are read in
+  // DELTA_UPDATE mode.
+  void flush_updates();
 
   vector<double> get_normalized_avg_strategy(uint64_t idx, int bucket);
+  // writes the normalized average strategy of the row to strategy.
+  void normalized_avg_strategy(uint64_t idx, int bucket, double *strategy);
 
   vector<double> get_normalized_avg_strategy(uint64_t idx, card_c hand,
                                              card_c board, int round);
@@ -61,27 +190,53 @@ public:
                                               vector<vector<double>> op,
                                               std::string path);
 
-  std::vector<vector<double>> br_public_chance(INode *curr_node,
-                                               vector<vector<double>> op,
-                                               std::string path );
-
-  std::vector<vector<double>> br_private_chance(INode *curr_node,
-                                                vector<vector<double>> op,
-                                                std::string path );
-
-  std::vector<vector<double>> br_terminal(INode *curr_node,
-                                          vector<vector<double>> op,
-                                          std::string path);
-
-  std::vector<vector<double>> br_infoset(INode *curr_node,
-                                         vector<vector<double>> op,
-                                         std::string path);
-
-  std::vector<vector<double>> best_response(INode *curr_node,
-                                            vector<vector<double>> op,
-                                            std::string path );
-
-  std::vector<double> best_response();
+  // hand lists of the decks in the public tree by deck bitset, filled once
+  // before the first best response.
+  std::unordered_map<uint64_t, br_board_t> br_boards;
+  // depth of the public tree.
+  unsigned br_depth = 0;
+
+  // entry of the deck of public tree hand index hand_idx, created on first
+  // use.
+  br_board_t &br_board(uint64_t hand_idx);
+  const br_board_t &br_cached_board(uint64_t hand_idx) const;
+  void prepare_best_response(INode *curr_node, unsigned depth);
+  // dense index of a sorted hand.
+  unsigned br_hand_key(const card_c &hand);
+
+  // the best response functions fill values with the value of every hand of
+  // both players at curr_node, given the reach op of every hand. the node
+  // uses the buffers of ws at depth, its subtree those below.
+  void br_deal_boards(PublicChanceNode *p, const double *const op[2],
+                      double *const sums[2], unsigned first, unsigned step,
+                      br_workspace_t &ws, unsigned depth);
+  void br_public_chance(INode *curr_node, const double *const op[2],
+                        double *const values[2], br_workspace_t &ws,
+                        unsigned depth);
+  void br_private_chance(INode *curr_node, const double *const op[2],
+                         double *const values[2], br_workspace_t &ws,
+                         unsigned depth);
+  void br_terminal(INode *curr_node, const double *const op[2],
+                   double *const values[2], br_workspace_t &ws);
+  void br_infoset(INode *curr_node, const double *const op[2],
+                  double *const values[2], br_workspace_t &ws, unsigned depth);
+  void best_response(INode *curr_node, const double *const op[2],
+                     double *const values[2], br_workspace_t &ws,
+                     unsigned depth);
+
+  // value of a best response against the average strategy for both
+  // players. with more than one thread the boards of the first public chance
+  // nodes are split over nb_threads threads.
+  std::vector<double> best_response(int nb_threads = 1);
+
+  // estimates how often every row of the average strategy is used when both
+  // players follow it, averaged over nb_deals sampled deals and indexed by
+  // row_index. branches a deal reaches with less than cutoff are not
+  // followed, so rows below cutoff are underestimated.
+  std::vector<double> row_reach(size_t nb_deals, double cutoff, nbgen &rng);
+
+  void accumulate_reach(const FlatNode *node, const hand_t &hand, double reach,
+                        double cutoff, std::vector<double> &reach_sum);
 
   void dump(char *filename);
 
@@ -169,16 +324,35 @@ public:
   virtual void iterate(nbgen &rng) = 0;
 };
 
+// external sampling with optional regret-based pruning. with a negative
+// prune_threshold the traverser skips the subtrees of actions whose regret
+// is below the threshold, except on every prune_interval-th iteration which
+// traverses everything to keep the pruned regrets correct.
 class ExternalSamplingCFR : public CFRM {
+  std::atomic<size_t> nb_iterations{0};
+  std::atomic<uint64_t> nb_explored{0};
+  std::atomic<uint64_t> nb_pruned{0};
+
 public:
+  double prune_threshold = 0;
+  size_t prune_interval = 20;
+
   ExternalSamplingCFR(AbstractGame *game) : CFRM(game) {}
   ExternalSamplingCFR(AbstractGame *game, char *strat_dump_file)
       : CFRM(game, strat_dump_file) {}
 
-  virtual void iterate(nbgen &rng);
+  virtual void iterate(nbgen &rng) { iterate(generate_hand(rng), rng); }
+  // one iteration on a dealt hand.
+  void iterate(const hand_t &hand, nbgen &rng);
+
+  double train(int trainplayer, const hand_t &hand, const FlatNode *node,
+               double p, double op, bool prune, nbgen &rng);
 
-  double train(int trainplayer, hand_t hand, INode *curr_node, double p,
-               double op, nbgen &rng);
+  // fraction of the traverser's actions that were pruned so far.
+  double pruned_fraction() const {
+    uint64_t pruned = nb_pruned, total = nb_explored + pruned;
+    return total ? (double)pruned / total : 0;
+  }
 };
 
 class ChanceSamplingCFR : public CFRM {
@@ -187,10 +361,11 @@ public:
   ChanceSamplingCFR(AbstractGame *game, char *strat_dump_file)
       : CFRM(game, strat_dump_file) {}
 
-  virtual void iterate(nbgen &rng);
+  virtual void iterate(nbgen &rng) { iterate(generate_hand(rng), rng); }
+  void iterate(const hand_t &hand, nbgen &rng);
 
-  double train(int trainplayer, hand_t hand, INode *curr_node, double p,
-               double op, nbgen &rng);
+  double train(int trainplayer, const hand_t &hand, const FlatNode *node,
+               double p, double op, nbgen &rng);
 };
 
 class OutcomeSamplingCFR : public CFRM {
@@ -199,10 +374,129 @@ public:
   OutcomeSamplingCFR(AbstractGame *game, char *strat_dump_file)
       : CFRM(game, strat_dump_file) {}
 
-  virtual void iterate(nbgen &rng);
+  virtual void iterate(nbgen &rng) { iterate(generate_hand(rng), rng); }
+  void iterate(const hand_t &hand, nbgen &rng);
 
-  vector<double> train(hand_t hand, INode *curr_node, vector<double> reach,
-                       double sp, nbgen &rng);
+  // writes the sampled values of both players into values.
+  void train(const hand_t &hand, const FlatNode *node, const double *reach,
+             double sp, nbgen &rng, double *values);
+};
+
+// CFR+ on chance sampled deals. regrets are floored at zero after every
+// update (regret matching+), the average strategy is weighted linearly with
+// the iteration and the players are updated alternately.
+class ChanceSamplingCFRPlus : public CFRM {
+  std::atomic<size_t> nb_iterations{0};
+
+public:
+  // iterations that do not contribute to the average strategy.
+  size_t averaging_delay = 0;
+
+  ChanceSamplingCFRPlus(AbstractGame *game) : CFRM(game) {}
+  ChanceSamplingCFRPlus(AbstractGame *game, char *strat_dump_file)
+      : CFRM(game, strat_dump_file) {}
+
+  virtual void iterate(nbgen &rng) { iterate(generate_hand(rng), rng); }
+  void iterate(const hand_t &hand, nbgen &rng);
+
+  double train(int trainplayer, const hand_t &hand, const FlatNode *node,
+               double p, double op, double weight, nbgen &rng);
+};
+
+// discounted CFR on externally sampled iterations. after every interval
+// iterations (one discount epoch) positive regrets are scaled by
+// t^alpha/(t^alpha+1), negative regrets by t^beta/(t^beta+1) and the average
+// strategy by (t/(t+1))^gamma. the discount is applied lazily when a bucket
+// row is visited, every row remembers the epoch it was discounted last.
+class DiscountedCFR : public CFRM {
+  std::atomic<size_t> nb_iterations{0};
+  std::unique_ptr<std::atomic<uint32_t>[]> row_epochs;
+  // cumulated log discount factors of the first e epochs up to MAX_EPOCHS.
+  vector<double> log_pos, log_neg;
+
+  void init_discounting();
+  void discount(uint64_t info_idx, unsigned bucket, uint32_t epoch);
+  // cumulated log discount factors of the first e epochs, for any e.
+  double log_pos_factor(uint32_t e) const;
+  double log_neg_factor(uint32_t e) const;
+  double log_avg_factor(uint32_t e) const { return -gamma * std::log(e + 1.0); }
+
+public:
+  // epochs of the factor tables. with beta = 0 the factors of later epochs
+  // are computed in closed form and discounting never stops. otherwise the
+  // negative regrets have no closed form and discounting stops after
+  // MAX_EPOCHS, which changes the algorithm for longer runs.
+  static const uint32_t MAX_EPOCHS = 1 << 16;
+
+  double alpha, beta, gamma;
+  size_t interval;
+
+  DiscountedCFR(AbstractGame *game, double alpha = 1.5, double beta = 0,
+                double gamma = 2, size_t interval = 1000)
+      : CFRM(game), alpha(alpha), beta(beta), gamma(gamma),
+        interval(interval) {
+    init_discounting();
+  }
+  DiscountedCFR(AbstractGame *game, char *strat_dump_file, double alpha = 1.5,
+                double beta = 0, double gamma = 2, size_t interval = 1000)
+      : CFRM(game, strat_dump_file), alpha(alpha), beta(beta), gamma(gamma),
+        interval(interval) {
+    init_discounting();
+  }
+
+  virtual void iterate(nbgen &rng) { iterate(generate_hand(rng), rng); }
+  void iterate(const hand_t &hand, nbgen &rng);
+
+  double train(int trainplayer, const hand_t &hand, const FlatNode *node,
+               double p, double op, uint32_t epoch, nbgen &rng);
+};
+
+// copy of the tables of a running sampler. checkpoints evaluate and write the
+// snapshot while the training threads keep updating the original.
+class Snapshot : public CFRM {
+public:
+  Snapshot(AbstractGame *game) : CFRM(game) {}
+
+  virtual void iterate(nbgen &rng) {
+    throw std::logic_error("snapshots can not be trained");
+  }
+
+  // copies the regrets and average strategy of cfr, which may be updated
+  // concurrently. the copy itself does not synchronize with the training
+  // threads, only the gate handshake of a caller that pauses them orders it
+  // after their updates. without a pause a value may be copied before or
+  // after a concurrent update, so the snapshot is not consistent across
+  // values. if cfr tracks dirty regions, their flags are taken and the
+  // changed regions collected.
+  void copy_from(CFRM &cfr);
+  // copies only the average strategy, which the best responses read. the
+  // dirty flags are left to copy_from.
+  void copy_avg_from(CFRM &cfr);
+
+  // regions of the regrets and average strategy that changed since the
+  // previous copy_from. an update that raced with taking the flags may only
+  // become visible after its region was copied, so every region is listed
+  // once more by the copy after the one that took its flag.
+  std::vector<uint64_t> changed_regrets;
+  std::vector<uint64_t> changed_avg;
+
+private:
+  std::vector<bool> recent_regrets;
+  std::vector<bool> recent_avg;
+};
+
+// sampler S specialized for game G and card abstraction A. the dispatcher in
+// cfrm-main instantiates one of these for the configured game, every
+// iteration then runs without virtual calls.
+template <class S, class G, class A> class SpecializedSampler final : public S {
+public:
+  template <class... Args>
+  SpecializedSampler(Args &&... args) : S(std::forward<Args>(args)...) {}
+
+  using S::iterate;
+  virtual void iterate(nbgen &rng) {
+    S::iterate(this->template generate_hand<G, A>(rng), rng);
+  }
 };
 
 #endif
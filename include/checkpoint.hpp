@@ -0,0 +1,200 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <string>
+#include <vector>
+#include "definitions.hpp"
+
+// on disk format of regrets and average strategies.
+//
+//   header     checkpoint_header_t, padded to CHECKPOINT_ALIGNMENT
+//   index      one checkpoint_index_t per information set, padded
+//   regrets    the EntryStore block of the regrets, padded
+//   avg        the EntryStore block of the average strategy
+//
+// both stores share the index. the data sections are aligned to pages, so
+// they are mapped straight into the EntryStores without copying.
+
+const char CHECKPOINT_MAGIC[8] = {'C', 'F', 'R', 'M', 'C', 'K', 'P', 'T'};
+const uint32_t CHECKPOINT_VERSION = 1;
+const uint64_t CHECKPOINT_ALIGNMENT = 4096;
+
+struct checkpoint_header_t {
+  char magic[8];
+  uint32_t version;
+  // bytes per stored value, 4 for float and 8 for double entries.
+  uint32_t value_size;
+  // layout_fingerprint of the game and abstraction the file was written for.
+  uint64_t fingerprint;
+  uint64_t nb_infosets;
+  // byte offsets of the sections and number of values in the data sections.
+  uint64_t index_offset;
+  uint64_t regrets_offset;
+  uint64_t avg_offset;
+  uint64_t nb_values;
+  uint64_t index_checksum;
+  uint64_t data_checksum;
+};
+
+struct checkpoint_index_t {
+  // offset of the first value of the information set in a data section.
+  uint64_t offset;
+  uint32_t nb_buckets;
+  uint32_t nb_entries;
+  uint32_t stride;
+  uint32_t reserved;
+};
+
+// on disk format of a compressed checkpoint. it holds the index and both
+// data sections of a checkpoint in chunks that are encoded and decoded
+// independently, so both run on all cores.
+//
+//   header     compressed_header_t
+//   index      one checkpoint_index_t per information set
+//   chunks     one compressed_chunk_t per chunk
+//   data       the encoded chunks
+//
+// the regrets are split into nb_chunks chunks of chunk_values values, then
+// the average strategy. a chunk is encoded by converting its values to
+// value_size bytes, shuffling the byte planes and compressing them with
+// lz_compress (codec.hpp). chunks that do not get smaller are stored after
+// shuffling.
+
+const char COMPRESSED_MAGIC[8] = {'C', 'F', 'R', 'M', 'C', 'M', 'P', 'R'};
+const uint32_t COMPRESSED_VERSION = 1;
+const uint64_t COMPRESSED_CHUNK_VALUES = 1 << 20;
+
+struct compressed_header_t {
+  char magic[8];
+  uint32_t version;
+  // bytes per value in the chunks, 4 if doubles were cut to floats.
+  uint32_t value_size;
+  uint64_t fingerprint;
+  uint64_t nb_infosets;
+  uint64_t nb_values;
+  uint64_t chunk_values;
+  // chunks per store.
+  uint64_t nb_chunks;
+  uint64_t index_offset;
+  uint64_t chunks_offset;
+  uint64_t index_checksum;
+};
+
+struct compressed_chunk_t {
+  uint64_t offset;
+  uint64_t bytes;
+  // over the converted values before shuffling.
+  uint64_t checksum;
+};
+
+// on disk format of a delta checkpoint, the regions of both stores that
+// changed since the previous checkpoint.
+//
+//   header     delta_header_t
+//   regions    numbers of the changed regions of the regrets, then of the
+//              average strategy
+//   values     the values of every listed region in the same order. the last
+//              region of a store may be shorter than region_values.
+//
+// a manifest names the full checkpoint a chain of deltas starts from and the
+// deltas in the order they have to be applied, one file per line:
+//
+//   base <checkpoint>
+//   delta <delta checkpoint>
+//   ...
+//
+// file names are relative to the directory of the manifest.
+
+const char DELTA_MAGIC[8] = {'C', 'F', 'R', 'M', 'D', 'L', 'T', 'A'};
+const uint32_t DELTA_VERSION = 1;
+
+struct delta_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t value_size;
+  uint64_t fingerprint;
+  // values per store and per region.
+  uint64_t nb_values;
+  uint64_t region_values;
+  uint64_t nb_regret_regions;
+  uint64_t nb_avg_regions;
+  // over the region numbers and values.
+  uint64_t checksum;
+};
+
+// hash over the number of information sets and the buckets and actions of
+// every information set. two trees with the same fingerprint can share a
+// strategy.
+uint64_t layout_fingerprint(const entry_c &store);
+
+// FNV-1a over 64 bit words, continued from seed.
+uint64_t checksum(const void *data, size_t bytes,
+                  uint64_t seed = 14695981039346656037ULL);
+
+// true if filename starts with the magic of a checkpoint or a compressed
+// checkpoint.
+bool is_checkpoint(const std::string &filename);
+
+bool is_compressed_checkpoint(const std::string &filename);
+
+// reads the header of a checkpoint. throws on files that are not checkpoints
+// or have an unsupported version.
+checkpoint_header_t read_checkpoint_header(const std::string &filename);
+
+compressed_header_t read_compressed_header(const std::string &filename);
+
+// fingerprint of a checkpoint or compressed checkpoint.
+uint64_t checkpoint_fingerprint(const std::string &filename);
+
+// writes regrets and avg_strategy to filename. the file is written next to
+// filename and renamed when it is complete, so readers never see a partial
+// checkpoint.
+void write_checkpoint(const std::string &filename, const entry_c &regrets,
+                      const entry_c &avg_strategy);
+
+// writes regrets and avg_strategy to filename as a compressed checkpoint,
+// with the values cut to floats if as_float is set. the chunks are encoded
+// by nb_threads threads, 0 uses every core.
+void write_compressed_checkpoint(const std::string &filename,
+                                 const entry_c &regrets,
+                                 const entry_c &avg_strategy, bool as_float,
+                                 unsigned nb_threads = 0);
+
+// maps the checkpoint filename into regrets and avg_strategy. throws if the
+// fingerprint of the file does not match fingerprint. files written with
+// another value type are converted into freshly allocated stores, compressed
+// checkpoints are decoded into them on every core.
+void read_checkpoint(const std::string &filename, entry_c &regrets,
+                     entry_c &avg_strategy, uint64_t fingerprint);
+
+// checks the data checksum of a checkpoint or the chunk checksums of a
+// compressed checkpoint. touches every page of the file.
+bool verify_checkpoint(const std::string &filename);
+
+// writes the listed regions of regrets and avg_strategy to filename,
+// renamed into place when complete like write_checkpoint.
+void write_delta(const std::string &filename, const entry_c &regrets,
+                 const entry_c &avg_strategy,
+                 const std::vector<uint64_t> &regret_regions,
+                 const std::vector<uint64_t> &avg_regions);
+
+// overwrites the regions stored in the delta filename. throws if the delta
+// was written for another layout or value type or is corrupt.
+void apply_delta(const std::string &filename, entry_c &regrets,
+                 entry_c &avg_strategy);
+
+// replaces manifest by one that lists files, the base checkpoint first.
+void write_manifest(const std::string &manifest,
+                    const std::vector<std::string> &files);
+
+// returns the files listed in manifest, the base checkpoint first, with
+// the directory of the manifest prepended.
+std::vector<std::string> read_manifest(const std::string &manifest);
+
+// reads the format written by CFRM::dump before checkpoints existed:
+// nb_infosets followed by nb_buckets, nb_entries and the double values of
+// every information set, first for the regrets then for the average strategy.
+void read_legacy_dump(const std::string &filename, entry_c &regrets,
+                      entry_c &avg_strategy);
+
+#endif
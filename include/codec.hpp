@@ -0,0 +1,31 @@
+#ifndef CODEC_HPP
+#define CODEC_HPP
+
+#include <vector>
+#include <cstddef>
+#include <inttypes.h>
+
+// byte plane shuffling: byte b of value i moves to b * nb_values + i. the
+// exponent bytes of values of similar magnitude and the bytes of zeros then
+// form long runs the lz coder compresses well.
+void shuffle_bytes(const uint8_t *in, uint8_t *out, size_t nb_values,
+                   size_t value_size);
+
+// inverse of shuffle_bytes.
+void unshuffle_bytes(const uint8_t *in, uint8_t *out, size_t nb_values,
+                     size_t value_size);
+
+// lz77 coder with a 64 KiB window in the block format of lz4: sequences of
+// a token (literal length in the high, match length - 4 in the low nibble,
+// 15 continued in bytes of up to 255), the literals, a 2 byte offset and the
+// rest of the match length. the last sequence has no match.
+//
+// appends the compressed n bytes of in to out.
+void lz_compress(const uint8_t *in, size_t n, std::vector<uint8_t> &out);
+
+// decompresses n bytes of in into the raw_bytes of out. throws if in is not
+// a valid block of exactly raw_bytes.
+void lz_decompress(const uint8_t *in, size_t n, uint8_t *out,
+                   size_t raw_bytes);
+
+#endif
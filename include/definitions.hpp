@@ -2,6 +2,7 @@
 #define DEFINITIONS_HPP
 
 #include <vector>
+#include <algorithm>
 #include <limits>
 #include <inttypes.h>
 #include <ecalc/xorshift_generator.hpp>
@@ -22,6 +23,29 @@ enum card_abstraction { CLUSTERCARD_ABS, NULLCARD_ABS, BLINDCARD_ABS };
 
 static const char *card_abstraction_str[] = {"CLUSTER", "NULL", "BLIND"};
 
+enum sampler_t {
+  EXTERNAL_SAMPLING,
+  CHANCE_SAMPLING,
+  OUTCOME_SAMPLING,
+  CFR_PLUS_SAMPLING,
+  DISCOUNTED_SAMPLING
+};
+
+static const char *sampler_str[] = {"EXTERNAL", "CHANCE", "OUTCOME",
+                                    "CFRPLUS", "DCFR"};
+
+// how concurrent training threads write regrets and average strategies.
+enum update_mode { HOGWILD_UPDATE, ATOMIC_UPDATE, STRIPED_UPDATE, DELTA_UPDATE };
+
+static const char *update_mode_str[] = {"HOGWILD", "ATOMIC", "STRIPED",
+                                        "DELTA"};
+
+// how CFRM::dump writes strategies: as mapped checkpoints, as compressed
+// checkpoints or as compressed checkpoints with the values cut to floats.
+enum compression_t { NO_COMPRESSION, LOSSLESS_COMPRESSION, FLOAT_COMPRESSION };
+
+static const char *compression_str[] = {"NONE", "LOSSLESS", "FLOAT"};
+
 const int MAX_ABSTRACT_ACTIONS = 20;
 
 const double DOUBLE_MAX = std::numeric_limits<double>::max();
@@ -30,39 +54,42 @@ static const char *ActionsStr[] = {"F", "C", "R", ""};
 
 typedef int _Bool; // needed by some c includes
 
-typedef Entry<double> entry_t;
+// value type of the regret and average strategy tables.
+#ifdef ENTRY_FLOAT
+typedef float entry_value_t;
+#else
+typedef double entry_value_t;
+#endif
+
+typedef Entry<entry_value_t> entry_t;
 
 typedef std::vector<uint8_t> card_c;
 typedef std::vector<int> int_c;
 typedef std::vector<double> dbl_c;
 typedef std::vector<Action> action_c;
-typedef std::vector<entry_t> entry_c;
+typedef EntryStore<entry_value_t> entry_c;
 typedef std::vector<card_c> hand_list;
 
 typedef ecalc::XOrShiftGenerator nbgen;
 
+// fixed size deal of hole and board cards. plain old data so it can be
+// copied and passed around in the training loops without allocating.
 struct hand_t {
   // +1 win, 0 tie, -1 lost per player
-  typedef std::vector<int8_t> result;
-
-  card_c board;
-  result value;
-  hand_list holes;
+  int8_t value[MAX_PLAYERS];
+  uint8_t holes[MAX_PLAYERS][MAX_HOLE_CARDS];
+  uint8_t board[MAX_BOARD_CARDS];
+  // bucket of every player in every round, filled once per deal.
+  int buckets[MAX_PLAYERS][MAX_ROUNDS];
 
   hand_t() {}
-  ~hand_t() {}
-
-  hand_t(hand_list holes, card_c board)
-      : value(holes.size()), holes(holes), board(board) {}
-
-  hand_t(const hand_t &oh)
-      : board(oh.board), holes(oh.holes), value(oh.value) {}
 
-  hand_t operator=(const hand_t &h) {
-    board = h.board;
-    holes = h.holes;
-    value = h.value;
-    return *this;
+  hand_t(const hand_list &hole_list, const card_c &board_cards) {
+    for (unsigned p = 0; p < hole_list.size(); ++p) {
+      value[p] = 0;
+      std::copy(hole_list[p].begin(), hole_list[p].end(), holes[p]);
+    }
+    std::copy(board_cards.begin(), board_cards.end(), board);
   }
 };
 
@@ -1,31 +1,248 @@
 #ifndef ENTRY_HPP
 #define ENTRY_HPP
 
+#include <atomic>
+#include <memory>
 #include <vector>
+#include <cstring>
+#include <stdexcept>
+#include <inttypes.h>
+#include <sys/mman.h>
 
+// byte alignment of every bucket row inside an EntryStore. 0 packs the rows
+// without padding, 64 starts every row on its own cache line.
+#ifndef ENTRY_ROW_ALIGNMENT
+#define ENTRY_ROW_ALIGNMENT 0
+#endif
+
+// bytes of an EntryStore block covered by one dirty flag.
+const size_t ENTRY_DIRTY_REGION_BYTES = 256;
+
+// view on the entries of one information set inside an EntryStore.
+// nb_buckets rows of nb_entries values each, rows are stride values apart.
 template <class T> class Entry {
 public:
   unsigned nb_buckets;
   unsigned nb_entries;
-  std::vector<T> entries;
+  unsigned stride;
+  T *entries;
+
+  Entry() : nb_buckets(0), nb_entries(0), stride(0), entries(NULL) {}
+
+  Entry(unsigned nb_buckets, unsigned nb_entries, unsigned stride, T *entries)
+      : nb_buckets(nb_buckets), nb_entries(nb_entries), stride(stride),
+        entries(entries) {}
+
+  T *row(unsigned bucket) const { return entries + bucket * stride; }
+};
+
+// regrets or average strategies of all information sets in one contiguous
+// block. the layout of every information set has to be set with init()
+// before the block is allocated with allocate().
+template <class T> class EntryStore {
+public:
+  // position and dimensions of one information set inside the block.
+  struct layout_t {
+    uint64_t offset;
+    uint64_t first_row;
+    unsigned nb_buckets;
+    unsigned nb_entries;
+    unsigned stride;
+  };
+
+private:
+  std::vector<layout_t> layout;
+  size_t row_alignment;
+  size_t nb_rows;
+  size_t nb_values;
+  size_t mapped_bytes;
+  T *block;
+  std::unique_ptr<std::atomic<uint8_t>[]> dirty;
+
+  void release() {
+    if (block)
+      munmap(block, mapped_bytes);
+    block = NULL;
+    nb_values = 0;
+    mapped_bytes = 0;
+    dirty.reset();
+  }
+
+  void map_block() {
+    mapped_bytes = nb_values * sizeof(T);
+    if (mapped_bytes == 0)
+      return;
+    // anonymous mappings are page aligned and zeroed lazily by the kernel.
+    void *mem = mmap(NULL, mapped_bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+      throw std::runtime_error("could not allocate entry store");
+    block = static_cast<T *>(mem);
+  }
 
-  Entry() : nb_buckets(0), nb_entries(0) {}
+public:
+  typedef T value_type;
+
+  EntryStore(size_t nb_infosets = 0,
+             size_t row_alignment = ENTRY_ROW_ALIGNMENT)
+      : layout(nb_infosets), row_alignment(row_alignment), nb_rows(0),
+        nb_values(0), mapped_bytes(0), block(NULL) {}
 
-  Entry(unsigned nb_buckets, unsigned nb_entries) {
-    init(nb_buckets, nb_entries);
+  EntryStore(const EntryStore &other)
+      : layout(other.layout), row_alignment(other.row_alignment),
+        nb_rows(other.nb_rows), nb_values(other.nb_values), mapped_bytes(0),
+        block(NULL) {
+    map_block();
+    if (block)
+      memcpy(block, other.block, nb_values * sizeof(T));
   }
 
-  void init(unsigned nb_buckets, unsigned nb_entries) {
-    this->nb_buckets = nb_buckets;
-    this->nb_entries = nb_entries;
-    entries = std::vector<T>(nb_buckets * nb_entries, 0);
+  EntryStore &operator=(const EntryStore &other) {
+    if (this != &other) {
+      release();
+      layout = other.layout;
+      row_alignment = other.row_alignment;
+      nb_rows = other.nb_rows;
+      nb_values = other.nb_values;
+      map_block();
+      if (block)
+        memcpy(block, other.block, nb_values * sizeof(T));
+    }
+    return *this;
   }
 
-  const std::vector<T> &operator[](const int index) const {
-    return entries[index];
+  ~EntryStore() { release(); }
+
+  // sets the dimensions of information set idx.
+  void init(uint64_t idx, unsigned nb_buckets, unsigned nb_entries) {
+    unsigned stride = nb_entries;
+    if (row_alignment > sizeof(T)) {
+      size_t per_line = row_alignment / sizeof(T);
+      stride = ((nb_entries + per_line - 1) / per_line) * per_line;
+    }
+    layout[idx] = {0, 0, nb_buckets, nb_entries, stride};
   }
 
-  T &operator[](const int index) { return entries[index]; }
+  // lays out all information sets in index order and allocates the
+  // zero initialized block.
+  void allocate() {
+    release();
+    size_t per_line = row_alignment > sizeof(T) ? row_alignment / sizeof(T) : 1;
+    uint64_t offset = 0;
+    nb_rows = 0;
+    for (size_t i = 0; i < layout.size(); ++i) {
+      offset = ((offset + per_line - 1) / per_line) * per_line;
+      layout[i].offset = offset;
+      layout[i].first_row = nb_rows;
+      offset += (uint64_t)layout[i].nb_buckets * layout[i].stride;
+      nb_rows += layout[i].nb_buckets;
+    }
+    nb_values = offset;
+    map_block();
+  }
+
+private:
+  // takes over a layout read from a file with values values in the block.
+  void set_layout(const std::vector<layout_t> &file_layout, size_t values) {
+    release();
+    layout = file_layout;
+    nb_rows = 0;
+    for (size_t i = 0; i < layout.size(); ++i) {
+      if (layout[i].offset + (uint64_t)layout[i].nb_buckets * layout[i].stride >
+          values)
+        throw std::runtime_error("entry layout exceeds the mapped values");
+      layout[i].first_row = nb_rows;
+      nb_rows += layout[i].nb_buckets;
+    }
+    nb_values = values;
+  }
+
+public:
+  // allocates a zero initialized block of values values laid out as given
+  // by file_layout.
+  void allocate(const std::vector<layout_t> &file_layout, size_t values) {
+    set_layout(file_layout, values);
+    map_block();
+  }
+
+  // uses nb_values values at byte offset of the open file fd as the block,
+  // laid out as given by file_layout. the mapping is private: pages are
+  // shared with every other process mapping the file until they are written.
+  void map_file(const std::vector<layout_t> &file_layout, size_t values,
+                int fd, uint64_t offset) {
+    set_layout(file_layout, values);
+    mapped_bytes = nb_values * sizeof(T);
+    if (mapped_bytes == 0)
+      return;
+    void *mem = mmap(NULL, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     fd, offset);
+    if (mem == MAP_FAILED)
+      throw std::runtime_error("could not map entry store");
+    block = static_cast<T *>(mem);
+  }
+
+  // values covered by one dirty flag.
+  static const size_t REGION_VALUES =
+      ENTRY_DIRTY_REGION_BYTES >= sizeof(T) ? ENTRY_DIRTY_REGION_BYTES / sizeof(T)
+                                            : 1;
+
+  // starts flagging the regions of the block that are written. the flags
+  // are dropped when the block is released or replaced.
+  void track_dirty() {
+    dirty.reset(new std::atomic<uint8_t>[regions()]);
+    for (size_t r = 0; r < regions(); ++r)
+      dirty[r].store(0, std::memory_order_relaxed);
+  }
+
+  bool tracks_dirty() const { return dirty != nullptr; }
+
+  size_t regions() const {
+    return (nb_values + REGION_VALUES - 1) / REGION_VALUES;
+  }
+
+  // flags the regions of the n values starting at first. returns false if
+  // no regions are tracked or first does not point into the block. a flag
+  // that is already set is not written again, so hot regions do not bounce
+  // between the caches of the training threads.
+  bool mark_dirty(const T *first, unsigned n) {
+    if (!dirty || first < block || first >= block + nb_values)
+      return false;
+    size_t offset = first - block;
+    for (size_t r = offset / REGION_VALUES; r <= (offset + n - 1) / REGION_VALUES;
+         ++r) {
+      if (!dirty[r].load(std::memory_order_relaxed))
+        dirty[r].store(1, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  // clears the flag of region r and returns whether it was set.
+  bool take_dirty(size_t r) {
+    return dirty[r].load(std::memory_order_relaxed) &&
+           dirty[r].exchange(0, std::memory_order_relaxed);
+  }
+
+  const std::vector<layout_t> &get_layout() const { return layout; }
+
+  Entry<T> operator[](uint64_t idx) const {
+    const layout_t &l = layout[idx];
+    return Entry<T>(l.nb_buckets, l.nb_entries, l.stride, block + l.offset);
+  }
+
+  // running number of the bucket row over all information sets.
+  uint64_t row_index(uint64_t idx, unsigned bucket) const {
+    return layout[idx].first_row + bucket;
+  }
+
+  size_t size() const { return layout.size(); }
+  size_t rows() const { return nb_rows; }
+  size_t values() const { return nb_values; }
+  size_t bytes() const {
+    return nb_values * sizeof(T) + layout.size() * sizeof(layout_t);
+  }
+  T *data() const { return block; }
 };
 
+template <class T> const size_t EntryStore<T>::REGION_VALUES;
+
 #endif
@@ -0,0 +1,149 @@
+#ifndef FLAT_TREE_HPP
+#define FLAT_TREE_HPP
+
+#include <vector>
+#include <string>
+#include "nodes.hpp"
+#include "definitions.hpp"
+
+enum flat_node_type : uint8_t { FLAT_INFOSET, FLAT_FOLD, FLAT_SHOWDOWN };
+
+// node of a FlatTree. 16 bytes, so four nodes share a cache line.
+struct FlatNode {
+  uint8_t type;
+  // acting player of an information set, folding player of a fold node.
+  uint8_t player;
+  uint8_t round;
+  uint8_t nb_children;
+  // index of the first child. the children of a node are stored next to
+  // each other.
+  uint32_t first_child;
+  union {
+    // information sets
+    uint64_t info_idx;
+    // fold and showdown nodes
+    double value;
+  };
+
+  bool is_terminal() const { return type != FLAT_INFOSET; }
+  bool is_fold() const { return type == FLAT_FOLD; }
+};
+
+// slot of the sequence index of a FlatTree. empty slots have hash 0.
+struct sequence_slot_t {
+  uint64_t hash;
+  uint32_t node;
+  // zero. explicit, so bundles do not store stale padding.
+  uint32_t unused;
+};
+
+// position of one hand in a FlatTree, moved forward by FlatTree::advance as
+// the actions of the hand arrive.
+struct tree_cursor_t {
+  uint32_t hand_id = 0;
+  // NO_NODE until the first lookup and after a miss.
+  uint32_t node = (uint32_t)-1;
+  // round and number of actions of that round already followed.
+  int round = 0;
+  int action = 0;
+  // raise sizes of the current node, kept to avoid allocations.
+  std::vector<double> sizes;
+};
+
+// the game tree in one array. a node reserves the slots of all its children
+// before the subtrees are laid out depth first, so siblings are contiguous
+// and a subtree is close to its root. the data that is only needed to look
+// up states is kept in separate arrays to keep the nodes small.
+//
+// a built tree owns its arrays. a mapped tree points into arrays that were
+// written by a built tree, e.g. in a bundle, and has no source nodes.
+class FlatTree {
+  std::vector<FlatNode> node_store;
+  std::vector<Action> action_store;
+  std::vector<sequence_slot_t> slot_store;
+  size_t nb_nodes;
+
+  void fill(uint32_t slot, INode *node);
+  void index_sequences(uint32_t node, uint64_t hash);
+  void insert_sequence(uint64_t hash, uint32_t node);
+
+  // child of node the action is mapped to, NO_NODE if there is none. raises
+  // are mapped with the pseudo harmonic mapping and a number of rng.
+  uint32_t step(uint32_t node, const Action &action,
+                std::vector<double> &sizes, nbgen &rng) const;
+
+  // open addressing table from sequence hashes to information set nodes.
+  const sequence_slot_t *sequence_table;
+  size_t nb_slots;
+
+public:
+  static const uint32_t NO_NODE = (uint32_t)-1;
+
+  const FlatNode *nodes;
+  // action that leads to every node.
+  const Action *actions;
+  // node of the pointer based tree every node was built from. empty for
+  // mapped trees.
+  std::vector<INode *> source;
+
+  FlatTree()
+      : nb_nodes(0), sequence_table(NULL), nb_slots(0), nodes(NULL),
+        actions(NULL) {}
+  FlatTree(INode *root);
+  // tree of nb_nodes nodes and actions with a sequence index of nb_slots
+  // slots (0 if it has none). the arrays must outlive the tree.
+  FlatTree(const FlatNode *nodes, const Action *actions, size_t nb_nodes,
+           const sequence_slot_t *sequence_table, size_t nb_slots);
+
+  // moving keeps the arrays of a built tree, copies would point into the
+  // arrays of the original.
+  FlatTree(FlatTree &&) = default;
+  FlatTree &operator=(FlatTree &&) = default;
+  FlatTree(const FlatTree &) = delete;
+  FlatTree &operator=(const FlatTree &) = delete;
+
+  const FlatNode *root() const { return nodes; }
+  const FlatNode *children(const FlatNode *node) const {
+    return nodes + node->first_child;
+  }
+  uint32_t index(const FlatNode *node) const { return node - nodes; }
+  size_t size() const { return nb_nodes; }
+  size_t bytes() const {
+    return nb_nodes * (sizeof(FlatNode) + sizeof(Action) + sizeof(INode *));
+  }
+  // slots of the sequence index, 0 without an index.
+  size_t sequence_slots() const { return nb_slots; }
+  const sequence_slot_t *sequence_index() const { return sequence_table; }
+
+  // index of the node the state leads to or NO_NODE if the state is not
+  // reachable in the abstraction. raises are mapped with the pseudo harmonic
+  // mapping like in AbstractGame::lookup_state, drawing from rng. sizes
+  // holds the raise sizes of a node while it is mapped.
+  uint32_t lookup_state(const State *state, std::vector<double> &sizes,
+                        nbgen &rng, uint32_t node = 0, int current_round = 0,
+                        int curr_action = 0) const;
+
+  // hash of the action sequence extended by action. only the size of raises
+  // is part of an action, the empty sequence hashes to SEQUENCE_SEED.
+  static uint64_t sequence_hash(uint64_t hash, const Action &action);
+  static const uint64_t SEQUENCE_SEED = 1;
+
+  // indexes every information set by the hash of the actions leading to
+  // it. sequences of different nodes are assumed not to collide in 64 bits.
+  void build_sequence_index();
+
+  // information set the actions of state lead to if they are all actions of
+  // the abstraction, NO_NODE otherwise or without an index.
+  uint32_t find_sequence(const State *state) const;
+
+  // node the actions of state lead to, like lookup_state. cursor remembers
+  // the node of the previous lookup, so only the new actions of the same
+  // hand are mapped. a new hand is looked up in the sequence index first.
+  // states that leave the abstraction fall back to lookup_state. raises
+  // that are not in the tree are translated with numbers of rng, so the
+  // node only depends on the state and the generator.
+  uint32_t advance(tree_cursor_t &cursor, const State *state,
+                   nbgen &rng) const;
+};
+
+#endif
@@ -50,6 +50,30 @@ template <class T = unsigned long> T choose(unsigned long n, unsigned long k) {
   return b;
 }
 
+/**
+ * Creates the random number generator of an independent stream. The seed of
+ * every stream is derived from the base seed and the stream id with the
+ * splitmix64 finalizer, so threads seeded with the same base seed and
+ * different ids do not share or overlap their sequences.
+ *
+ * @param seed
+ *   Base seed shared by all streams.
+ * @param stream
+ *   Id of the stream, e.g. the thread id.
+ */
+static nbgen make_rng_stream(uint64_t seed, uint64_t stream) {
+  uint64_t z = seed + (stream + 1) * 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z = z ^ (z >> 31);
+
+  nbgen rng((uint32_t)(z ^ (z >> 32)));
+  // the xorshift state is nearly linear in the seed, skip the first numbers.
+  for (unsigned i = 0; i < 64; ++i)
+    rng();
+  return rng;
+}
+
 static uint64_t deck_to_bitset(std::vector<uint8_t> &deck) {
   uint64_t bitset = 0;
   for (unsigned i = 0; i < deck.size(); ++i)
@@ -0,0 +1,69 @@
+#ifndef LBR_HPP
+#define LBR_HPP
+
+#include <vector>
+#include <ecalc/handranks.hpp>
+#include "definitions.hpp"
+#include "flat_tree.hpp"
+
+class AgentStrategy;
+
+// local best response (lisy and bowling, 2017) against an agent. in every
+// decision lbr keeps the range of the agent, the probability of each hole
+// card combination given the agent's actions so far, and picks the action
+// with the best value assuming the hand is checked down after the agent's
+// answer: fold, call or one of the raises, for which the fold probability
+// of the range is read from the agent's strategy. the winnings of lbr are a
+// lower bound on the exploitability of the agent.
+class LocalBestResponse {
+  const Game *game;
+  const AgentStrategy &agent;
+  // showdowns are ranked with the table if set, with the acpc evaluator
+  // otherwise.
+  const ecalc::Handranks *handranks;
+  // raises considered by lbr as fractions of the pot, sized like the pot
+  // relation abstraction. in no limit games the all in is considered too.
+  std::vector<double> bet_fractions;
+  // boards sampled for the equity before the river. a missing river is
+  // enumerated.
+  unsigned nb_rollouts;
+  // every hole card combination of the deck.
+  hand_list hands;
+
+public:
+  LocalBestResponse(const Game *game, const AgentStrategy &agent,
+                    const ecalc::Handranks *handranks,
+                    const std::vector<double> &bet_fractions,
+                    unsigned nb_rollouts);
+
+  // plays one dealt hand between lbr in seat lbr_seat and the agent and
+  // returns the chips won by lbr.
+  double play_hand(uint32_t hand_id, unsigned lbr_seat, nbgen &rng) const;
+
+  // probability that lbr holding the hole cards of lbr_seat in state wins
+  // the showdown against range, ties count half.
+  double equity(const State &state, unsigned lbr_seat,
+                const std::vector<double> &range, nbgen &rng) const;
+
+private:
+  // chooses the action of lbr in state. if it raises, cursor is moved to
+  // the node of the agent the fold probabilities were read from.
+  Action best_action(const State &state, unsigned lbr_seat,
+                     tree_cursor_t &cursor,
+                     const std::vector<double> &range, nbgen &rng) const;
+  // action of the agent in state. multiplies the range by the probability
+  // of the chosen action for every hand.
+  Action agent_action(const State &state, unsigned agent_seat,
+                      tree_cursor_t &cursor, std::vector<double> &range,
+                      nbgen &rng) const;
+  // fills fold with the probability that the agent folds every hand of
+  // range in state and moves cursor to state. false if the state is not in
+  // the agent's tree.
+  bool fold_probabilities(const State &state, unsigned agent_seat,
+                          tree_cursor_t &cursor,
+                          const std::vector<double> &range,
+                          std::vector<double> &fold, nbgen &rng) const;
+  card_c board_cards(const State &state) const;
+};
+
+#endif
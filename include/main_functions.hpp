@@ -3,8 +3,13 @@
 
 #include <cstdlib>
 #include <string>
+#include <iostream>
+#include <chrono>
 #include "card_abstraction.hpp"
 #include "action_abstraction.hpp"
+#include "abstract_game.hpp"
+#include "agent_strategy.hpp"
+#include "bundle.hpp"
 
 std::vector<std::string> &split(const std::string &s, char delim,
                                 std::vector<std::string> &elems) {
@@ -75,4 +80,51 @@ ActionAbstraction *load_action_abstraction(const Game *gamedef,
   throw std::runtime_error("unknown action abstraction");
 }
 
+// agent playing init_strategy. a bundle brings its own game, tree, card
+// abstraction and policy, gamedef is set to its game. policies and
+// checkpoints are played in the holdem game tree of gamedef and the given
+// abstractions.
+AgentStrategy *load_agent(const std::string &init_strategy,
+                          const Game *&gamedef, card_abstraction card_abs_type,
+                          const string &card_abs_param,
+                          action_abstraction action_abs_type,
+                          const string &action_abs_param) {
+  auto start = std::chrono::steady_clock::now();
+  AgentStrategy *agent;
+  if (is_bundle(init_strategy)) {
+    Bundle *bundle = new Bundle(init_strategy);
+    gamedef = bundle->get_gamedef();
+    CardAbstraction *card_abs = bundle->cluster_abstraction();
+    if (card_abs == NULL)
+      card_abs = load_card_abstraction(gamedef, bundle->get_card_abs(),
+                                       bundle->get_card_abs_param());
+    std::cout << "mapped bundle of " << bundle->bytes() / 1024 << " kb with "
+              << bundle->tree().size() << " nodes\n";
+    agent = new AgentStrategy(*bundle, card_abs);
+  } else {
+    std::cout << "using information abstraction type: "
+              << card_abstraction_str[card_abs_type]
+              << " with parameter: " << card_abs_param << "\n";
+    CardAbstraction *card_abs =
+        load_card_abstraction(gamedef, card_abs_type, card_abs_param);
+
+    std::cout << "using action abstraction type: "
+              << action_abstraction_str[action_abs_type]
+              << " with parameter: " << action_abs_param << "\n";
+    ActionAbstraction *action_abs =
+        load_action_abstraction(gamedef, action_abs_type, action_abs_param);
+
+    AbstractGame *agame = new HoldemGame(gamedef, card_abs, action_abs, NULL);
+    std::cout << "created holdem game tree.\n";
+    std::cout << "Number of informationsets:" << agame->get_nb_infosets()
+              << "\n";
+    agent = new AgentStrategy(agame, init_strategy);
+  }
+  std::cout << "strategy ready after "
+            << std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start).count()
+            << "s\n";
+  return agent;
+}
+
 #endif
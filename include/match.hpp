@@ -0,0 +1,61 @@
+#ifndef MATCH_HPP
+#define MATCH_HPP
+
+#include <ecalc/handranks.hpp>
+#include "definitions.hpp"
+
+class AgentStrategy;
+
+// head to head match between two agents in process, on the acpc state
+// machine. every deal is played twice with the seats swapped, so the luck
+// of the cards mostly cancels (duplicate poker). the winnings are also
+// corrected with an aivat style control variate (burch et al., 2018): at
+// every chance node and every decision the value of the outcome is replaced
+// by its expectation over the dealt cards or the acting agent's strategy.
+// states are valued by the equity of both hands with the pot checked down.
+// the corrections have zero mean, the estimate stays unbiased.
+class HeadToHead {
+  const Game *game;
+  // the first and the second agent.
+  const AgentStrategy *agents[2];
+  // showdowns are ranked with the table if set, with the acpc evaluator
+  // otherwise.
+  const ecalc::Handranks *handranks;
+  // boards sampled for the equity if more than two board cards are missing.
+  // fewer are enumerated.
+  unsigned nb_rollouts;
+
+public:
+  // chips won by the first agent in both hands of a deal, indexed by its
+  // seat.
+  struct deal_result_t {
+    double won[2];
+    double corrected[2];
+  };
+
+  HeadToHead(const Game *game, const AgentStrategy &first,
+             const AgentStrategy &second, const ecalc::Handranks *handranks,
+             unsigned nb_rollouts);
+
+  // deals cards for deal_id and plays them in both seatings. the random
+  // numbers, also those translating raises that are not in an agent's
+  // tree, only depend on seed and deal_id.
+  deal_result_t play_deal(uint64_t deal_id, uint64_t seed) const;
+
+private:
+  // plays the dealt state with the first agent in seat. equity[r] is the
+  // probability that seat 0 wins the showdown knowing the board of round r.
+  void play_hand(State state, unsigned seat, const double *equity,
+                 nbgen &rng, double &won, double &corrected) const;
+  // action the acting agent plays with the i-th action of node. abstract
+  // raises are moved to the nearest valid size, invalid actions call.
+  Action played_action(const State &state, const AgentStrategy &agent,
+                       uint32_t node, unsigned i) const;
+  // value of state for seat with the pot checked down, knowing the board of
+  // round.
+  double value(const State &state, int round, unsigned seat,
+               const double *equity) const;
+  double showdown_equity(const State &state, int round, nbgen &rng) const;
+};
+
+#endif
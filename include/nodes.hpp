@@ -49,10 +49,10 @@ public:
   virtual void init_entries(entry_c &regrets, entry_c &avg_strategy,
                             const Game *game,
                             CardAbstraction *card_abstraction) {
-    regrets[idx].init(card_abstraction->get_nb_buckets(game, round),
+    regrets.init(idx, card_abstraction->get_nb_buckets(game, round),
+                 children.size());
+    avg_strategy.init(idx, card_abstraction->get_nb_buckets(game, round),
                       children.size());
-    avg_strategy[idx].init(card_abstraction->get_nb_buckets(game, round),
-                           children.size());
     for (unsigned i = 0; i < children.size(); ++i) {
       children[i]->init_entries(regrets, avg_strategy, game, card_abstraction);
     }
@@ -66,7 +66,7 @@ public:
   virtual bool is_private_chance() { return false; }
   unsigned get_round() { return round; }
   uint64_t get_idx() { return idx; }
-  std::vector<INode *> get_children() { return children; }
+  const std::vector<INode *> &get_children() { return children; }
 };
 
 class ShowdownNode : public INode {
@@ -0,0 +1,114 @@
+#ifndef POLICY_HPP
+#define POLICY_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include "definitions.hpp"
+
+class AbstractGame;
+
+// on disk format of a policy, the normalized average strategy of every
+// bucket quantized to 8 or 16 bits per action. the player needs nothing
+// else, so it maps a policy instead of a checkpoint.
+//
+//   header     policy_header_t, padded to CHECKPOINT_ALIGNMENT
+//   index      one policy_index_t per information set, padded
+//   masks      only if rows were pruned: (nb_buckets + 63) / 64 words per
+//              information set, bit b is set if bucket b is stored. padded
+//   data       nb_entries probabilities per stored row, without padding
+//
+// an information set stores the rows of its buckets in order. rows that are
+// rarely reached can be pruned: only the stored buckets are kept, followed
+// by one fallback row that is used for all pruned buckets. probabilities
+// are stored as round(p * (2^bits - 1)) and renormalized to sum to one when
+// they are read. version 1 files have no masks.
+
+const char POLICY_MAGIC[8] = {'C', 'F', 'R', 'M', 'P', 'L', 'C', 'Y'};
+const uint32_t POLICY_VERSION = 2;
+
+struct policy_header_t {
+  char magic[8];
+  uint32_t version;
+  // bits per probability, 8 or 16.
+  uint32_t bits;
+  // layout_fingerprint of the game and abstraction the policy belongs to.
+  uint64_t fingerprint;
+  uint64_t nb_infosets;
+  uint64_t nb_values;
+  uint64_t index_offset;
+  uint64_t data_offset;
+  uint64_t index_checksum;
+  uint64_t data_checksum;
+  // 0 if no rows were pruned.
+  uint64_t mask_offset;
+  uint64_t nb_mask_words;
+};
+
+struct policy_index_t {
+  // offset of the first probability of the information set in the data.
+  uint64_t offset;
+  uint32_t nb_buckets;
+  uint32_t nb_entries;
+};
+
+// true if filename starts with the policy magic.
+bool is_policy(const std::string &filename);
+
+policy_header_t read_policy_header(const std::string &filename);
+
+// checks the data checksum of a policy, which Policy leaves out to map large
+// policies quickly. reads the whole file.
+bool verify_policy(const std::string &filename);
+
+// writes the normalized average strategy of avg_strategy to filename with
+// bits (8 or 16) per probability. normalization follows
+// CFRM::get_normalized_avg_strategy. rows whose reach (indexed by
+// row_index, see CFRM::row_reach) is below threshold are pruned, the
+// fallback row of an information set is the reach weighted average of its
+// pruned rows.
+void write_policy(const std::string &filename, const entry_c &avg_strategy,
+                  unsigned bits,
+                  const std::vector<double> &reach = std::vector<double>(),
+                  double threshold = 0);
+
+// writes the policy to fs. offsets in the policy are relative to the
+// position of fs at the start.
+void write_policy(std::ostream &fs, const entry_c &avg_strategy,
+                  unsigned bits, const std::vector<double> &reach,
+                  double threshold);
+
+// read only mapping of a policy file.
+class Policy {
+  policy_header_t header;
+  const policy_index_t *index;
+  const uint64_t *masks;
+  const uint8_t *data;
+  // first mask word of every information set, empty if nothing is pruned.
+  std::vector<uint64_t> mask_start;
+  // MAP_FAILED for a policy that is part of a larger mapping.
+  void *mapping;
+  size_t mapped_bytes;
+
+  void attach(const uint8_t *base, const std::string &name);
+
+public:
+  // maps filename. throws if it was not written for the game and card
+  // abstraction of game.
+  Policy(AbstractGame *game, const std::string &filename);
+  // policy stored in the bytes at image, which must outlive it. throws if
+  // it was not written for a strategy with the given layout_fingerprint.
+  Policy(const void *image, size_t bytes, uint64_t fingerprint);
+  ~Policy();
+
+  Policy(const Policy &) = delete;
+  Policy &operator=(const Policy &) = delete;
+
+  unsigned get_bits() const { return header.bits; }
+  size_t bytes() const { return mapped_bytes; }
+
+  std::vector<double> get_normalized_avg_strategy(uint64_t idx,
+                                                  int bucket) const;
+};
+
+#endif
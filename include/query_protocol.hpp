@@ -0,0 +1,56 @@
+#ifndef QUERY_PROTOCOL_HPP
+#define QUERY_PROTOCOL_HPP
+
+#include <inttypes.h>
+
+// binary protocol of the strategy query server. all integers are in host
+// byte order, the server only listens on a local unix socket.
+//
+// a client sends batches of queries and receives one response per batch,
+// in order:
+//
+//   request    query_batch_t, then per query a uint16_t length followed by
+//              an acpc match state without the newline, e.g.
+//              "MATCHSTATE:0:12:cr300:Kh9s|"
+//   response   query_batch_t, then per query a query_result_t followed by
+//              nb_actions query_action_t
+//
+// a query is answered with the strategy of the viewing player. batches that
+// are malformed or larger than QUERY_MAX_BATCH close the connection, as do
+// incomplete batches longer than QUERY_MAX_BATCH states of the acpc line
+// length.
+
+const uint32_t QUERY_MAGIC = 0x51524643; // "CFRQ"
+const uint32_t QUERY_MAX_BATCH = 1 << 16;
+
+enum query_status_t {
+  QUERY_OK = 0,
+  // the match state could not be parsed.
+  QUERY_BAD_STATE = 1,
+  // the hand is over or the viewing player does not act.
+  QUERY_NOT_ACTING = 2,
+  // the actions of the state left the abstract game tree.
+  QUERY_OFF_TREE = 3
+};
+
+#pragma pack(push, 1)
+struct query_batch_t {
+  uint32_t magic;
+  uint32_t nb_queries;
+};
+
+struct query_result_t {
+  uint8_t status;
+  uint8_t nb_actions;
+};
+
+struct query_action_t {
+  // ActionType of the acpc server.
+  uint8_t type;
+  // raise to size, 0 for other actions.
+  int32_t size;
+  float probability;
+};
+#pragma pack(pop)
+
+#endif
@@ -15,6 +15,7 @@ AbstractGame::AbstractGame(const Game *game_definition,
   initState(game, 0, &initial_state);
 
   game_tree = init_game_tree({a_invalid, 0}, initial_state, game, idx);
+  flat_tree = FlatTree(game_tree);
   public_tree = NULL;
 
   nb_infosets = idx;
@@ -154,7 +155,7 @@ INode *AbstractGame::init_public_tree(Action action, State &state,
             });
         nb_active_threads++;
         if (nb_active_threads >= nb_threads || i == (nb_combinations - 1)) {
-          for (unsigned t = 0; t < nb_threads; ++t)
+          for (unsigned t = 0; t < nb_active_threads; ++t)
             threadpool[t].join();
           nb_active_threads = 0;
         }
@@ -239,7 +240,7 @@ hand_list AbstractGame::generate_hole_combinations(int hand_size, card_c deck) {
 
 INode *AbstractGame::game_tree_root() { return game_tree; }
 INode *AbstractGame::public_tree_root() {
-  if (!public_tree) {
+  std::call_once(public_tree_once, [this] {
     uint64_t idi = 0;
     public_tree_cache =
         std::vector<uint64_t>(100); // better estimate initial value
@@ -249,7 +250,7 @@ INode *AbstractGame::public_tree_root() {
     public_tree = init_public_tree({a_invalid, 0}, initial_state, idi, {}, deck,
                                    game, idi, true);
     std::cout << idi << "\n";
-  }
+  });
   return public_tree;
 }
 
@@ -260,42 +261,11 @@ KuhnGame::KuhnGame(const Game *game_definition, CardAbstraction *cabs,
                    ActionAbstraction *aabs, int nb_threads)
     : AbstractGame(game_definition, cabs, aabs, nb_threads) {}
 
-void KuhnGame::evaluate(hand_t &hand) {
-  hand.value[0] =
-      rankOfCard(hand.holes[0][0]) > rankOfCard(hand.holes[1][0]) ? 1 : -1;
-  hand.value[1] = hand.value[0] * -1;
-}
-
 // LEDUC
 LeducGame::LeducGame(const Game *game_definition, CardAbstraction *cabs,
                      ActionAbstraction *aabs, int nb_threads)
     : AbstractGame(game_definition, cabs, aabs, nb_threads) {}
 
-void LeducGame::evaluate(hand_t &hand) {
-  int p1r = rank_hand(hand.holes[0][0], hand.board[0]);
-  int p2r = rank_hand(hand.holes[1][0], hand.board[0]);
-
-  if (p1r > p2r) {
-    hand.value[0] = 1;
-    hand.value[1] = -1;
-  } else if (p1r < p2r) {
-    hand.value[0] = -1;
-    hand.value[1] = 1;
-  } else {
-    hand.value[0] = 0;
-    hand.value[1] = 0;
-  }
-}
-
-int LeducGame::rank_hand(int hand, int board) {
-  int h = rankOfCard(hand);
-  int b = rankOfCard(board);
-
-  if (h == b)
-    return 100;
-  return h;
-}
-
 HoldemGame::HoldemGame(const Game *game_definition, CardAbstraction *cabs,
                        ActionAbstraction *aabs, ecalc::Handranks *hr,
                        int nb_threads)
@@ -304,9 +274,9 @@ HoldemGame::HoldemGame(const Game *game_definition, CardAbstraction *cabs,
 void HoldemGame::evaluate(hand_t &hand) {
   using namespace ecalc;
 
-  card_c p1 = hand.holes[0];
-  card_c p2 = hand.holes[1];
-  card_c board = hand.board;
+  const uint8_t *p1 = hand.holes[0];
+  const uint8_t *p2 = hand.holes[1];
+  const uint8_t *board = hand.board;
 
   bitset bboard =
       CREATE_BOARD(board[0], board[1], board[2], board[3], board[4]);
@@ -325,3 +295,10 @@ void HoldemGame::evaluate(hand_t &hand) {
     hand.value[1] = 0;
   }
 }
+
+int HoldemGame::hand_strength(const card_c &hole, const card_c &board) {
+  using namespace ecalc;
+  bitset bboard =
+      CREATE_BOARD(board[0], board[1], board[2], board[3], board[4]);
+  return LOOKUP_HAND(handranks, CREATE_HAND(hole[0], hole[1]) | bboard);
+}
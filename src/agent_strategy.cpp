@@ -0,0 +1,50 @@
+#include <iostream>
+#include "agent_strategy.hpp"
+#include "bundle.hpp"
+#include "cfrm.hpp"
+#include "policy.hpp"
+
+AgentStrategy::AgentStrategy(AbstractGame *game, const std::string &filename)
+    : gamedef(game->get_gamedef()), tree(&game->flat_game_tree()),
+      card_abs(game->card_abstraction()), cfr(NULL), policy(NULL),
+      own_policy(NULL) {
+  if (is_policy(filename)) {
+    policy = own_policy = new Policy(game, filename);
+    std::cout << "mapped " << policy->get_bits() << " bit policy of "
+              << policy->bytes() / 1024 << " kb\n";
+  } else {
+    cfr = new ChanceSamplingCFR(game, (char *)filename.c_str());
+    std::cout << "CFR Initialized\n";
+  }
+  game->index_action_sequences();
+}
+
+AgentStrategy::AgentStrategy(const Bundle &bundle, CardAbstraction *card_abs)
+    : gamedef(bundle.get_gamedef()), tree(&bundle.tree()), card_abs(card_abs),
+      cfr(NULL), policy(&bundle.policy()), own_policy(NULL) {}
+
+AgentStrategy::~AgentStrategy() {
+  delete cfr;
+  delete own_policy;
+}
+
+std::vector<double> AgentStrategy::strategy(uint32_t node,
+                                            const MatchState &state) const {
+  card_c hand(gamedef->numHoleCards);
+  for (int i = 0; i < gamedef->numHoleCards; ++i)
+    hand[i] = state.state.holeCards[state.viewingPlayer][i];
+
+  card_c board;
+  for (int c = 0; c < sumBoardCards(gamedef, state.state.round); ++c)
+    board.push_back(state.state.boardCards[c]);
+  return strategy(node, hand, board, state.state.round);
+}
+
+std::vector<double> AgentStrategy::strategy(uint32_t node, const card_c &hand,
+                                            const card_c &board,
+                                            int round) const {
+  int bucket = card_abs->map_hand_to_bucket(hand, board, round);
+  uint64_t idx = tree->nodes[node].info_idx;
+  return policy ? policy->get_normalized_avg_strategy(idx, bucket)
+                : cfr->get_normalized_avg_strategy(idx, bucket);
+}
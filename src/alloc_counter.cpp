@@ -0,0 +1,21 @@
+#include <new>
+#include <cstdlib>
+#include "alloc_counter.hpp"
+
+#ifdef COUNT_ALLOCATIONS
+static thread_local size_t nb_allocations = 0;
+
+void *operator new(size_t size) {
+  ++nb_allocations;
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+size_t thread_allocations() { return nb_allocations; }
+#else
+size_t thread_allocations() { return 0; }
+#endif
@@ -0,0 +1,40 @@
+#include "board_ranker.hpp"
+#include "evalHandTables"
+
+BoardRanker::BoardRanker(const ecalc::Handranks *handranks,
+                         const uint8_t *cards, int nb_board_cards,
+                         int nb_hole_cards)
+    : handranks(handranks), nb_hole_cards(nb_hole_cards), table_state(53),
+      board(0) {
+  Cardset c = emptyCardset();
+  for (int i = 0; i < nb_board_cards; ++i) {
+    // the table counts cards from 1.
+    if (handranks)
+      table_state = (*handranks)[table_state + cards[i] + 1];
+    else
+      addCardToCardset(&c, suitOfCard(cards[i]), rankOfCard(cards[i]));
+  }
+  board = c.cards;
+}
+
+int BoardRanker::operator()(const uint8_t *hole) const {
+  if (handranks) {
+    int s = table_state;
+    for (int i = 0; i < nb_hole_cards; ++i)
+      s = (*handranks)[s + hole[i] + 1];
+    return s;
+  }
+  Cardset c;
+  c.cards = board;
+  for (int i = 0; i < nb_hole_cards; ++i)
+    addCardToCardset(&c, suitOfCard(hole[i]), rankOfCard(hole[i]));
+  return rankCardset(c);
+}
+
+bool holds_card(const card_c &hand, const uint8_t *cards, int n) {
+  for (unsigned c = 0; c < hand.size(); ++c)
+    for (int i = 0; i < n; ++i)
+      if (hand[c] == cards[i])
+        return true;
+  return false;
+}
@@ -0,0 +1,220 @@
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bundle.hpp"
+#include "policy.hpp"
+#include "checkpoint.hpp"
+#include "card_abstraction.hpp"
+
+using std::string;
+using std::runtime_error;
+
+static uint64_t align(uint64_t offset) {
+  return (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT *
+         CHECKPOINT_ALIGNMENT;
+}
+
+static void pad_to(std::ofstream &fs, uint64_t offset) {
+  static const char zeros[CHECKPOINT_ALIGNMENT] = {};
+  uint64_t pos = fs.tellp();
+  if (pos < offset)
+    fs.write(zeros, offset - pos);
+}
+
+bool is_bundle(const string &filename) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(BUNDLE_MAGIC)];
+  if (!file.read(magic, sizeof(magic)))
+    return false;
+  return memcmp(magic, BUNDLE_MAGIC, sizeof(magic)) == 0;
+}
+
+void write_bundle(const string &filename, const Game *game,
+                  card_abstraction card_abs_type, const string &card_abs_param,
+                  CardAbstraction *card_abs, const FlatTree &tree,
+                  const entry_c &avg_strategy, unsigned bits,
+                  const std::vector<double> &reach, double threshold) {
+  if (tree.sequence_slots() == 0)
+    throw runtime_error("the tree of a bundle needs a sequence index");
+  if (card_abs_param.size() >= sizeof(bundle_header_t::card_abs_param))
+    throw runtime_error("card abstraction parameter is too long for a bundle");
+
+  bundle_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+  header.version = BUNDLE_VERSION;
+  header.card_abs = card_abs_type;
+  strcpy(header.card_abs_param, card_abs_param.c_str());
+  header.fingerprint = layout_fingerprint(avg_strategy);
+  // readGame leaves the entries of absent players and rounds unset. only
+  // the used ones are copied, so a strategy always gives the same file.
+  Game &g = header.game;
+  g.bettingType = game->bettingType;
+  g.numPlayers = game->numPlayers;
+  g.numRounds = game->numRounds;
+  g.numSuits = game->numSuits;
+  g.numRanks = game->numRanks;
+  g.numHoleCards = game->numHoleCards;
+  for (int p = 0; p < game->numPlayers; ++p) {
+    g.stack[p] = game->stack[p];
+    g.blind[p] = game->blind[p];
+  }
+  for (int r = 0; r < game->numRounds; ++r) {
+    g.raiseSize[r] = game->raiseSize[r];
+    g.firstPlayer[r] = game->firstPlayer[r];
+    g.maxRaises[r] = game->maxRaises[r];
+    g.numBoardCards[r] = game->numBoardCards[r];
+  }
+
+  size_t node_bytes = tree.size() * sizeof(FlatNode);
+  size_t action_bytes = tree.size() * sizeof(Action);
+  size_t slot_bytes = tree.sequence_slots() * sizeof(sequence_slot_t);
+  header.nb_nodes = tree.size();
+  header.nodes_offset = CHECKPOINT_ALIGNMENT;
+  header.actions_offset = align(header.nodes_offset + node_bytes);
+  header.nb_sequence_slots = tree.sequence_slots();
+  header.sequences_offset = align(header.actions_offset + action_bytes);
+  uint64_t end = header.sequences_offset + slot_bytes;
+  uint64_t hash = checksum(tree.nodes, node_bytes);
+  hash = checksum(tree.actions, action_bytes, hash);
+  hash = checksum(tree.sequence_index(), slot_bytes, hash);
+
+  ClusterCardAbstraction *cluster =
+      card_abs_type == CLUSTERCARD_ABS
+          ? dynamic_cast<ClusterCardAbstraction *>(card_abs)
+          : NULL;
+  if (cluster) {
+    for (int r = 0; r < game->numRounds; ++r) {
+      header.nb_buckets[r] = cluster->get_nb_buckets(game, r);
+      header.table_size[r] = cluster->table_size(r);
+      header.table_offset[r] = align(end);
+      end = header.table_offset[r] + header.table_size[r] * sizeof(unsigned);
+      hash = checksum(cluster->bucket_table(r),
+                      header.table_size[r] * sizeof(unsigned), hash);
+    }
+  }
+  header.policy_offset = align(end);
+  header.checksum = hash;
+
+  string tmpfile = filename + ".tmp";
+  std::ofstream fs(tmpfile.c_str(), std::ios::out | std::ios::binary);
+  fs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  pad_to(fs, header.nodes_offset);
+  fs.write(reinterpret_cast<const char *>(tree.nodes), node_bytes);
+  pad_to(fs, header.actions_offset);
+  fs.write(reinterpret_cast<const char *>(tree.actions), action_bytes);
+  pad_to(fs, header.sequences_offset);
+  fs.write(reinterpret_cast<const char *>(tree.sequence_index()), slot_bytes);
+  if (cluster) {
+    for (int r = 0; r < game->numRounds; ++r) {
+      pad_to(fs, header.table_offset[r]);
+      fs.write(reinterpret_cast<const char *>(cluster->bucket_table(r)),
+               header.table_size[r] * sizeof(unsigned));
+    }
+  }
+  pad_to(fs, header.policy_offset);
+  write_policy(fs, avg_strategy, bits, reach, threshold);
+
+  // the size of the policy is only known now.
+  header.policy_bytes = (uint64_t)fs.tellp() - header.policy_offset;
+  fs.seekp(0);
+  fs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  fs.close();
+  if (!fs)
+    throw runtime_error("could not write bundle " + tmpfile);
+  if (rename(tmpfile.c_str(), filename.c_str()) != 0)
+    throw runtime_error("could not rename " + tmpfile + " to " + filename);
+}
+
+Bundle::Bundle(const string &filename) : mapping(MAP_FAILED), mapped_bytes(0) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    throw runtime_error("could not read bundle " + filename);
+  if (memcmp(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0)
+    throw runtime_error(filename + " is not a bundle");
+  if (header.version != BUNDLE_VERSION)
+    throw runtime_error(filename + " has unsupported bundle version " +
+                        std::to_string(header.version));
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw runtime_error("could not open bundle " + filename);
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (uint64_t)st.st_size < header.policy_offset + header.policy_bytes) {
+    close(fd);
+    throw runtime_error("truncated bundle " + filename);
+  }
+  mapped_bytes = st.st_size;
+  mapping = mmap(NULL, mapped_bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    throw runtime_error("could not map bundle " + filename);
+
+  const uint8_t *base = static_cast<const uint8_t *>(mapping);
+  try {
+    mapped_policy.reset(new Policy(base + header.policy_offset,
+                                   header.policy_bytes, header.fingerprint));
+  } catch (...) {
+    munmap(mapping, mapped_bytes);
+    throw;
+  }
+  flat_tree = FlatTree(
+      reinterpret_cast<const FlatNode *>(base + header.nodes_offset),
+      reinterpret_cast<const Action *>(base + header.actions_offset),
+      header.nb_nodes,
+      reinterpret_cast<const sequence_slot_t *>(base +
+                                                header.sequences_offset),
+      header.nb_sequence_slots);
+
+  if (header.table_size[0] > 0) {
+    const unsigned *tables[MAX_ROUNDS];
+    for (int r = 0; r < header.game.numRounds; ++r)
+      tables[r] =
+          reinterpret_cast<const unsigned *>(base + header.table_offset[r]);
+    cluster.reset(new ClusterCardAbstraction(header.game.numRounds,
+                                             header.nb_buckets, tables));
+  }
+
+  // the tree and its index are needed for the first decision, read them
+  // ahead while the rest starts up.
+  madvise(mapping, header.sequences_offset +
+                       header.nb_sequence_slots * sizeof(sequence_slot_t),
+          MADV_WILLNEED);
+}
+
+Bundle::~Bundle() {
+  // the policy and tree point into the mapping.
+  mapped_policy.reset();
+  if (mapping != MAP_FAILED)
+    munmap(mapping, mapped_bytes);
+}
+
+CardAbstraction *Bundle::cluster_abstraction() const { return cluster.get(); }
+
+bool Bundle::verify() const {
+  const uint8_t *base = static_cast<const uint8_t *>(mapping);
+  uint64_t hash =
+      checksum(base + header.nodes_offset, header.nb_nodes * sizeof(FlatNode));
+  hash = checksum(base + header.actions_offset,
+                  header.nb_nodes * sizeof(Action), hash);
+  hash = checksum(base + header.sequences_offset,
+                  header.nb_sequence_slots * sizeof(sequence_slot_t), hash);
+  for (int r = 0; r < header.game.numRounds; ++r)
+    if (header.table_size[r] > 0)
+      hash = checksum(base + header.table_offset[r],
+                      header.table_size[r] * sizeof(unsigned), hash);
+  if (hash != header.checksum)
+    return false;
+
+  policy_header_t policy;
+  memcpy(&policy, base + header.policy_offset, sizeof(policy));
+  return checksum(base + header.policy_offset + policy.data_offset,
+                  policy.nb_values * (policy.bits / 8)) ==
+         policy.data_checksum;
+}
@@ -1,7 +1,10 @@
 #include <locale>
 #include <chrono>
+#include <mutex>
 #include <thread>
+#include <atomic>
 #include <iomanip>
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
 #include <boost/program_options.hpp>
@@ -12,6 +15,9 @@
 #include "action_abstraction.hpp"
 #include "abstract_game.hpp"
 #include "cfrm.hpp"
+#include "checkpoint.hpp"
+#include "policy.hpp"
+#include "alloc_counter.hpp"
 #include "main_functions.hpp"
 #include "functions.cpp"
 
@@ -22,24 +28,43 @@ using std::exception;
 namespace ch = std::chrono;
 namespace po = boost::program_options;
 
-#define CFR_SAMPLER ExternalSamplingCFR
+// iterations a thread runs before it passes the turn in deterministic mode.
+const size_t DETERMINISTIC_BATCH = 1000;
 
 struct {
   game_t type = leduc;
   string handranks_path = "/usr/local/freedom/data/handranks.dat";
   string game_definition = "../../games/leduc.limit.2p.game";
 
+  sampler_t sampler = EXTERNAL_SAMPLING;
+  size_t averaging_delay = 0;
+  double prune_threshold = 0;
+  size_t prune_interval = 20;
+  double dcfr_alpha = 1.5;
+  double dcfr_beta = 0;
+  double dcfr_gamma = 2;
+  size_t discount_interval = 1000;
+
   card_abstraction card_abs = NULLCARD_ABS;
   action_abstraction action_abs = NULLACTION_ABS;
   string card_abs_param = "";
   string action_abs_param = "";
 
   int nb_threads = 6;
+  // threads of the best response, 0 for nb_threads.
+  int nb_br_threads = 0;
   size_t seed = time(NULL);
+  bool deterministic = false;
+  update_mode update = HOGWILD_UPDATE;
 
   double runtime = 50;
   size_t nb_target_iterations = 0;
   double checkpoint_time = -1;
+  // seconds between two exploitability measurements of the monitor, -1 for
+  // none. the run stops once the exploitability is at most the target.
+  double monitor_time = -1;
+  string monitor_file = "";
+  double target_exploitability = -1;
 
   string dump_strategy = ""; //"holdem.2p.6std.bigabs.limit.strategy";
   string init_strategy = "";
@@ -48,22 +73,83 @@ struct {
   bool print_strategy = false;
   bool print_best_response = false;
   bool print_abstract_best_response = true;
+  bool benchmark_tree = false;
+  bool generic = false;
+  bool sync_checkpoint = false;
+  size_t delta_checkpoints = 0;
+  compression_t compression = NO_COMPRESSION;
+
+  string export_policy = "";
+  string export_bundle = "";
+  unsigned policy_bits = 8;
+  double policy_reach_threshold = 0;
+  size_t policy_deals = 100000;
+  // fixed, so exporting a strategy twice prunes the same rows.
+  uint64_t policy_seed = 0;
 } options;
 
 const Game *gamedef;
 ecalc::Handranks *handranks;
 
+// lets the main thread or the monitor stop the training threads between two
+// iterations and wait until all of them stopped. the threads continue once
+// every pause is resumed.
+struct pause_gate_t {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<bool> requested{false};
+  int nb_running = 0;
+  int nb_pausing = 0;
+
+  // blocks while a pause is requested, then counts the caller as running.
+  void enter() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] { return !requested; });
+    ++nb_running;
+  }
+
+  void leave() {
+    std::lock_guard<std::mutex> lock(mutex);
+    --nb_running;
+    cv.notify_all();
+  }
+
+  // returns once no thread is running.
+  void pause() {
+    std::unique_lock<std::mutex> lock(mutex);
+    ++nb_pausing;
+    requested = true;
+    cv.wait(lock, [this] { return nb_running == 0; });
+  }
+
+  void resume() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (nb_pausing > 0)
+      --nb_pausing;
+    requested = nb_pausing > 0;
+    cv.notify_all();
+  }
+};
+
 int parse_options(int argc, char **argv);
 void read_game(char *game_definition);
+CFRM *load_sampler(sampler_t sampler, AbstractGame *game,
+                   string init_strategy);
 template <class T> std::string comma_format(T value);
+void checkpoint(CFRM *tables, CFRM *cfr, size_t iterations,
+                std::string checkfile, const Snapshot *delta = NULL);
+void benchmark_tree(AbstractGame *game);
+std::vector<double> policy_reach(CFRM *cfr, AbstractGame *game);
+void export_policy(CFRM *cfr, const std::vector<double> &reach);
+void export_bundle(CFRM *cfr, AbstractGame *game, CardAbstraction *card_abs,
+                   const std::vector<double> &reach);
 
 int main(int argc, char **argv) {
 unsigned curr_check = 1;
   if (parse_options(argc, argv) == 1)
     return 1;
 
-  cout << "initializing rng with seed: " << options.seed << "\n";
-  nbgen rng(options.seed);
+  cout << "initializing thread rngs with seed: " << options.seed << "\n";
 
   cout << "loading handranks from: " << options.handranks_path << "\n";
   handranks = new ecalc::Handranks(options.handranks_path.c_str());
@@ -101,13 +187,26 @@ unsigned curr_check = 1;
     break;
   };
 
-  CFRM *cfr;
-  if (options.init_strategy == "")
-    cfr = new CFR_SAMPLER(game);
-  else {
-    std::cout << "Initializing tree with " << options.init_strategy << "\n";
-    cfr = new CFR_SAMPLER(game, (char *)options.init_strategy.c_str());
+  cout << "using sampler: " << sampler_str[options.sampler] << "\n";
+  // checkpoints do not keep the iteration count. a resumed dcfr run would
+  // discount the loaded tables with the factors of the first epochs again,
+  // a resumed cfr+ run weight its new iterations from 1 against the loaded
+  // average.
+  bool exporting = options.export_policy != "" || options.export_bundle != "";
+  if ((options.sampler == DISCOUNTED_SAMPLING ||
+       options.sampler == CFR_PLUS_SAMPLING) &&
+      options.init_strategy != "" && !exporting) {
+    cout << (options.sampler == DISCOUNTED_SAMPLING ? "dcfr" : "cfr+")
+         << " runs can not be resumed from a checkpoint.\n";
+    return 1;
   }
+  if (options.init_strategy != "")
+    std::cout << "Initializing tree with " << options.init_strategy << "\n";
+  CFRM *cfr = load_sampler(options.sampler, game, options.init_strategy);
+
+  cout << "using update mode: " << update_mode_str[options.update] << "\n";
+  cfr->mode = options.update;
+  cfr->compression = options.compression;
 
   //std::cout << "Game tree size: " << cfr->count_bytes(game->game_tree_root()) /
                                          //1024 << " kb\n";
@@ -116,91 +215,328 @@ unsigned curr_check = 1;
   std::cout << "Number of terminalnodes:" << cfr->count_terminal_nodes(game->game_tree_root()) << "\n";
   std::cout << "Number of states:" << cfr->count_states(game->game_tree_root()) << "\n";
 
+  if (options.benchmark_tree) {
+    benchmark_tree(game);
+    return 0;
+  }
+
+  if (options.export_policy != "" || options.export_bundle != "") {
+    std::vector<double> reach = policy_reach(cfr, game);
+    if (options.export_policy != "")
+      export_policy(cfr, reach);
+    if (options.export_bundle != "")
+      export_bundle(cfr, game, card_abs, reach);
+    return 0;
+  }
+
+
+  // delta checkpoints write the regions flagged since the previous
+  // checkpoint, so the flags have to be set from the first iteration on.
+  bool write_deltas = options.delta_checkpoints > 0 &&
+                      options.checkpoint_time >= 0 &&
+                      options.dump_strategy != "";
+  if (write_deltas) {
+    cfr->regrets.track_dirty();
+    cfr->avg_strategy.track_dirty();
+  }
 
   auto runtime = ch::milliseconds((int)(options.runtime * 1000));
   auto checkpoint_time =
       ch::milliseconds((int)(options.checkpoint_time * 1000));
   auto start = ch::steady_clock::now();
   auto checkpoint_start = ch::steady_clock::now();
-  bool pause_threads = false;
-  bool stop_threads = false;
+  std::atomic<bool> stop_threads(false);
+  pause_gate_t gate;
 
   vector<std::thread> iter_threads(options.nb_threads);
   vector<size_t> iter_threads_cnt(options.nb_threads, 0);
+  vector<size_t> iter_threads_allocs(options.nb_threads, 0);
+
+  // in deterministic mode every thread runs a fixed share of the target
+  // iterations and the threads take turns in a fixed order. the result then
+  // only depends on the seed and the number of threads.
+  vector<size_t> iter_threads_quota(options.nb_threads, 0);
+  std::mutex turn_mutex;
+  std::condition_variable turn_cv;
+  int turn = 0;
+  std::atomic<int> nb_finished_threads(0);
+  if (options.deterministic) {
+    size_t nb_threads = options.nb_threads;
+    for (size_t i = 0; i < nb_threads; ++i)
+      iter_threads_quota[i] = options.nb_target_iterations / nb_threads +
+                              (i < options.nb_target_iterations % nb_threads);
+  }
 
   // start threads
   for (int i = 0; i < options.nb_threads; ++i) {
-    iter_threads[i] = std::thread([&stop_threads, &pause_threads, &rng, &cfr, i,
-                                   &iter_threads_cnt] {
-      while (!stop_threads) {
-        while (!pause_threads) {
+    iter_threads[i] = std::thread([&stop_threads, &gate, &cfr, i,
+                                   &iter_threads_cnt, &iter_threads_allocs,
+                                   &iter_threads_quota, &turn_mutex, &turn_cv,
+                                   &turn, &nb_finished_threads] {
+      nbgen rng = make_rng_stream(options.seed, i);
+      int nb_threads = options.nb_threads;
+
+      if (!options.deterministic) {
+        gate.enter();
+        while (!stop_threads) {
+          if (gate.requested.load(std::memory_order_relaxed)) {
+            cfr->flush_updates();
+            gate.leave();
+            gate.enter();
+            continue;
+          }
+          size_t allocs = thread_allocations();
           cfr->iterate(rng);
+          iter_threads_allocs[i] += thread_allocations() - allocs;
           ++iter_threads_cnt[i];
         }
-        std::this_thread::sleep_for(ch::milliseconds(100));
+        cfr->flush_updates();
+        gate.leave();
+      }
+
+      while (options.deterministic && !stop_threads &&
+             iter_threads_cnt[i] < iter_threads_quota[i]) {
+        std::unique_lock<std::mutex> lock(turn_mutex);
+        turn_cv.wait(lock, [&turn, &stop_threads, i] {
+          return turn == i || stop_threads;
+        });
+        lock.unlock();
+
+        gate.enter();
+        size_t batch_end = std::min(iter_threads_quota[i],
+                                    iter_threads_cnt[i] + DETERMINISTIC_BATCH);
+        while (!stop_threads && iter_threads_cnt[i] < batch_end) {
+          if (gate.requested.load(std::memory_order_relaxed)) {
+            cfr->flush_updates();
+            gate.leave();
+            gate.enter();
+            continue;
+          }
+          size_t allocs = thread_allocations();
+          cfr->iterate(rng);
+          iter_threads_allocs[i] += thread_allocations() - allocs;
+          ++iter_threads_cnt[i];
+        }
+
+        cfr->flush_updates();
+        gate.leave();
+
+        // pass the turn to the next thread with iterations left.
+        lock.lock();
+        int next = i;
+        do {
+          next = (next + 1) % nb_threads;
+        } while (next != i &&
+                 iter_threads_cnt[next] >= iter_threads_quota[next]);
+        turn = next;
+        turn_cv.notify_all();
+      }
+      ++nb_finished_threads;
+    });
+  }
+
+  // the checkpoint writer copies the tables into a snapshot while training
+  // continues, then evaluates and writes the snapshot. the main thread hands
+  // it one checkpoint at a time.
+  Snapshot *snapshot = NULL;
+  std::mutex writer_mutex;
+  std::condition_variable writer_cv;
+  bool writer_pending = false, writer_stop = false;
+  size_t writer_iterations = 0;
+  std::string writer_file;
+  std::thread writer;
+  if (options.checkpoint_time >= 0 && !options.sync_checkpoint) {
+    snapshot = new Snapshot(game);
+    snapshot->compression = options.compression;
+    writer = std::thread([&] {
+      // the full checkpoint and the deltas written after it.
+      std::vector<std::string> chain;
+      size_t nb_written = 0;
+      std::unique_lock<std::mutex> lock(writer_mutex);
+      while (true) {
+        writer_cv.wait(lock, [&] { return writer_pending || writer_stop; });
+        if (!writer_pending)
+          break;
+        size_t iterations = writer_iterations;
+        std::string file = writer_file;
+        lock.unlock();
+
+        auto copy_start = ch::steady_clock::now();
+        snapshot->copy_from(*cfr);
+        double copy_time =
+            ch::duration<double>(ch::steady_clock::now() - copy_start).count();
+        cout << "snapshot taken in " << copy_time << "s\n";
+        if (write_deltas) {
+          bool delta = nb_written++ % options.delta_checkpoints != 0;
+          if (delta)
+            file += ".delta";
+          else
+            chain.clear();
+          checkpoint(snapshot, cfr, iterations, file,
+                     delta ? snapshot : NULL);
+          chain.push_back(file);
+          write_manifest(options.dump_strategy + ".manifest", chain);
+        } else {
+          checkpoint(snapshot, cfr, iterations, file);
+        }
+
+        lock.lock();
+        writer_pending = false;
+        writer_cv.notify_all();
+      }
+    });
+  }
+
+  // the monitor pauses the training to copy the average strategy, then
+  // computes the best response of the copy while training continues and
+  // appends it to the time series.
+  Snapshot *monitored = NULL;
+  std::mutex monitor_mutex;
+  std::condition_variable monitor_cv;
+  bool monitor_stop = false;
+  std::atomic<bool> target_reached(false);
+  std::thread monitor;
+  if (options.monitor_time > 0) {
+    monitored = new Snapshot(game);
+    std::string file = options.monitor_file;
+    if (file == "")
+      file = (options.dump_strategy != "" ? options.dump_strategy : "cfrm") +
+             ".exploitability";
+    cout << "writing exploitability to: " << file << "\n";
+    // the best response runs next to the training threads, on the cores they
+    // leave free.
+    int nb_br_threads = options.nb_br_threads;
+    if (nb_br_threads <= 0)
+      nb_br_threads = std::max(
+          1, (int)std::thread::hardware_concurrency() - options.nb_threads);
+    monitor = std::thread([&, file, nb_br_threads] {
+      std::ofstream series(file);
+      series << "# seconds iterations br0 br1 exploitability\n";
+      auto interval = ch::milliseconds((int)(options.monitor_time * 1000));
+      std::unique_lock<std::mutex> lock(monitor_mutex);
+      while (!monitor_cv.wait_for(lock, interval,
+                                  [&] { return monitor_stop; })) {
+        lock.unlock();
+        gate.pause();
+        monitored->copy_avg_from(*cfr);
+        size_t iterations = 0;
+        for (unsigned i = 0; i < iter_threads_cnt.size(); ++i)
+          iterations += iter_threads_cnt[i];
+        double seconds =
+            ch::duration<double>(ch::steady_clock::now() - start).count();
+        gate.resume();
+
+        vector<double> br =
+            options.print_abstract_best_response &&
+                    !options.print_best_response
+                ? monitored->abstract_best_response()
+                : monitored->best_response(nb_br_threads);
+        double exploitability = br[0] + br[1];
+        series << seconds << "\t" << iterations << "\t" << br[0] << "\t"
+               << br[1] << "\t" << exploitability << std::endl;
+        cout << "exploitability after " << comma_format(iterations)
+             << " iterations: " << exploitability << "\n";
+        if (options.target_exploitability >= 0 &&
+            exploitability <= options.target_exploitability)
+          target_reached = true;
+        lock.lock();
       }
     });
   }
 
-  // blast away as long we have time
-  while (ch::duration_cast<ch::milliseconds>(ch::steady_clock::now() - start)
-             .count() <= runtime.count()) {
+  // blast away as long we have time or, in deterministic mode, until every
+  // thread ran its iterations.
+  while (options.deterministic
+             ? nb_finished_threads < options.nb_threads
+             : ch::duration_cast<ch::milliseconds>(ch::steady_clock::now() -
+                                                   start).count() <=
+                   runtime.count()) {
     std::this_thread::sleep_for(ch::milliseconds(10));
+    if (target_reached) {
+      std::cout << "target exploitability reached. exiting.\n";
+      break;
+    }
     if (options.checkpoint_time < 0 ||
         ch::duration_cast<ch::milliseconds>(ch::steady_clock::now() -
                                             checkpoint_start).count() <=
             checkpoint_time.count())
       continue;
-
-    pause_threads = true;
-    // graceful pause
-    std::this_thread::sleep_for(ch::milliseconds(100));
-
-    if (options.print_best_response) {
-      vector<double> br = cfr->best_response();
-      cout << "BR :" << br[0] << " + " << br[1] << " = " << br[0] + br[1]
-           << "\n";
-    }
-
-    if (options.print_abstract_best_response) {
-      vector<double> br = cfr->abstract_best_response();
-      cout << "ABR :" << br[0] << " + " << br[1] << " = " << br[0] + br[1]
-           << "\n";
-    }
-
-    if (options.dump_strategy != "") {
-      size_t iter_cnt_sum = 0;
-      for (unsigned i = 0; i < iter_threads_cnt.size(); ++i)
-        iter_cnt_sum += iter_threads_cnt[i];
-      std::string checkfile = options.dump_strategy + "." + std::to_string(curr_check);
-      cout << "Saving current strategy to " << checkfile << "...\n";
-      cfr->dump((char *)checkfile.c_str());
-      ++curr_check;
-    }
+    checkpoint_start = ch::steady_clock::now();
 
     size_t iter_cnt_sum = 0;
     for (unsigned i = 0; i < iter_threads_cnt.size(); ++i)
       iter_cnt_sum += iter_threads_cnt[i];
-    std::cout << "#iterations: " << comma_format(iter_cnt_sum) << "\n";
+    std::string checkfile = "";
+    if (options.dump_strategy != "")
+      checkfile = options.dump_strategy + "." + std::to_string(curr_check++);
+
+    if (snapshot) {
+      std::lock_guard<std::mutex> lock(writer_mutex);
+      if (writer_pending) {
+        cout << "previous checkpoint is still being written, skipping.\n";
+      } else {
+        writer_iterations = iter_cnt_sum;
+        writer_file = checkfile;
+        writer_pending = true;
+        writer_cv.notify_all();
+      }
+    } else {
+      gate.pause();
+      checkpoint(cfr, cfr, iter_cnt_sum, checkfile);
+      gate.resume();
+    }
+
     if(options.nb_target_iterations > 0 && iter_cnt_sum >= options.nb_target_iterations){
         std::cout << "specified iterations reached. exiting.\n"; 
         break; 
     }
-
-    pause_threads = false;
-    checkpoint_start = ch::steady_clock::now();
   }
 
   stop_threads = true;
-  pause_threads = true;
+  if (monitored) {
+    {
+      std::lock_guard<std::mutex> lock(monitor_mutex);
+      monitor_stop = true;
+      monitor_cv.notify_all();
+    }
+    monitor.join();
+    delete monitored;
+  }
+  gate.resume();
+  {
+    std::lock_guard<std::mutex> lock(turn_mutex);
+    turn_cv.notify_all();
+  }
   for (int i = 0; i < options.nb_threads; ++i) {
     iter_threads[i].join();
   }
 
+  if (snapshot) {
+    std::unique_lock<std::mutex> lock(writer_mutex);
+    writer_cv.wait(lock, [&] { return !writer_pending; });
+    writer_stop = true;
+    writer_cv.notify_all();
+    lock.unlock();
+    writer.join();
+    delete snapshot;
+  }
+
   size_t iter_cnt_sum = 0;
   for (unsigned i = 0; i < iter_threads_cnt.size(); ++i)
     iter_cnt_sum += iter_threads_cnt[i];
   std::cout << "#iterations: " << comma_format(iter_cnt_sum) << "\n";
+  double elapsed = ch::duration_cast<ch::milliseconds>(
+                       ch::steady_clock::now() - start).count() / 1000.0;
+  std::cout << "#iterations/s: " << comma_format(iter_cnt_sum / elapsed)
+            << "\n";
+#ifdef COUNT_ALLOCATIONS
+  size_t alloc_cnt_sum = 0;
+  for (unsigned i = 0; i < iter_threads_allocs.size(); ++i)
+    alloc_cnt_sum += iter_threads_allocs[i];
+  std::cout << "#allocations per iteration: "
+            << alloc_cnt_sum / (double)std::max(iter_cnt_sum, (size_t)1)
+            << "\n";
+#endif
    //std::cout << "Public tree size: "
   //<< cfr->count_bytes(game->public_tree_root()) / 1024 << " kb\n";
 
@@ -223,7 +559,25 @@ int parse_options(int argc, char **argv) {
     po::options_description desc("Allowed options");
     desc.add_options()("help,h", "produce help message")(
         "game-type,t", po::value<string>(),
-        "kuhn,leduc,holdem")("card-abstraction,c", po::value<string>(),
+        "kuhn,leduc,holdem")(
+        "sampler,s", po::value<string>(),
+        "external, chance, outcome, cfrplus or dcfr. default: external")(
+        "prune-threshold", po::value<double>(&options.prune_threshold),
+        "external: skip actions with regret below this negative threshold. "
+        "default: 0 (no pruning)")(
+        "prune-interval", po::value<size_t>(&options.prune_interval),
+        "external: every n-th iteration traverses all actions. default: 20")(
+        "averaging-delay", po::value<size_t>(&options.averaging_delay),
+        "cfrplus: iterations that do not contribute to the average "
+        "strategy.")(
+        "dcfr-alpha", po::value<double>(&options.dcfr_alpha),
+        "dcfr: discount exponent of positive regrets. default: 1.5")(
+        "dcfr-beta", po::value<double>(&options.dcfr_beta),
+        "dcfr: discount exponent of negative regrets. default: 0")(
+        "dcfr-gamma", po::value<double>(&options.dcfr_gamma),
+        "dcfr: discount exponent of the average strategy. default: 2")(
+        "discount-interval", po::value<size_t>(&options.discount_interval),
+        "dcfr: iterations between two discounts. default: 1000")("card-abstraction,c", po::value<string>(),
                              "set the card abstraction to use.")(
         "card-abstraction-param,m", po::value<string>(&options.card_abs_param),
         "parameter passed to the card abstraction.")(
@@ -239,7 +593,43 @@ int parse_options(int argc, char **argv) {
         "dump-strategy,d", po::value<string>(&options.dump_strategy),
         "safe generated strategy to file.")(
         "init-strategy,i", po::value<string>(&options.init_strategy),
-        "initialize regrets with an existing strategy")(
+        "initialize regrets with an existing strategy. cfrplus and dcfr runs "
+        "can not be resumed, checkpoints do not keep the iteration count.")(
+        "sync-checkpoint", po::bool_switch(&options.sync_checkpoint),
+        "stop training during checkpoints instead of evaluating a snapshot. "
+        "saves the memory of the snapshot.")(
+        "compress-strategy", po::value<string>(),
+        "write strategies compressed: none, lossless or float, which also "
+        "cuts the values to floats. default: none")(
+        "delta-checkpoints", po::value<size_t>(&options.delta_checkpoints),
+        "write every n-th checkpoint in full and only the regions changed "
+        "since the previous checkpoint in between. <dump>.manifest lists the "
+        "files to combine with strategy-tool compact. default: 0 (always "
+        "full)")(
+        "generic", po::bool_switch(&options.generic),
+        "use the virtually dispatched sampler instead of the one specialized "
+        "for the game and card abstraction.")(
+        "export-policy", po::value<string>(&options.export_policy),
+        "write the average strategy of --init-strategy as a policy for the "
+        "player and exit.")(
+        "export-bundle", po::value<string>(&options.export_bundle),
+        "write the flat game tree, the bucket tables of a cluster abstraction "
+        "and the policy of --init-strategy to one file the player maps at "
+        "startup, and exit. takes the policy options of export-policy.")(
+        "policy-bits", po::value<unsigned>(&options.policy_bits),
+        "export-policy: bits per probability, 8 or 16. default: 8")(
+        "policy-reach-threshold",
+        po::value<double>(&options.policy_reach_threshold),
+        "export-policy: replace the rows both players reach less often by one "
+        "fallback row per information set. default: 0 (keep all)")(
+        "policy-deals", po::value<size_t>(&options.policy_deals),
+        "export-policy: deals sampled to estimate the reach of the rows, "
+        "should be well above 1 / threshold. default: 100000")(
+        "policy-seed", po::value<uint64_t>(&options.policy_seed),
+        "export-policy: seed of the sampled deals. default: 0")(
+        "benchmark-tree", po::bool_switch(&options.benchmark_tree),
+        "compare traversal speed and size of the pointer based and the flat "
+        "game tree and exit.")(
         "print-strategy,p", po::bool_switch(&options.print_strategy),
         "print strategy in human readable format")(
         "print-best-response,b", po::bool_switch(&options.print_best_response),
@@ -248,8 +638,31 @@ int parse_options(int argc, char **argv) {
         "calculate best response of the abstract game at checkpoints. ( if game is to big for normal br )")(
         "threads", po::value<int>(&options.nb_threads),
         "set number of threads to use. default: 1")(
+        "monitor", po::value<double>(&options.monitor_time),
+        "measure the exploitability of a copy of the average strategy every "
+        "n seconds while training continues. uses the best response of -b, "
+        "or the abstract one if only -x is set. its best response runs on "
+        "--br-threads threads, default: the cores not used by --threads, at "
+        "least 1.")(
+        "monitor-file", po::value<string>(&options.monitor_file),
+        "time series of the monitor: seconds, iterations, both best "
+        "responses and their sum. default: <dump-strategy>.exploitability")(
+        "target-exploitability",
+        po::value<double>(&options.target_exploitability),
+        "stop once the monitor measures at most this exploitability. needs "
+        "--monitor.")(
+        "br-threads", po::value<int>(&options.nb_br_threads),
+        "set number of threads computing the best response. default: number "
+        "of threads, see --monitor for the monitor")(
         "seed", po::value<size_t>(&options.seed),
         "set seed to use. default: current time")(
+        "update-mode", po::value<string>(),
+        "how threads write regrets: hogwild, atomic, striped or delta. "
+        "default: hogwild")(
+        "deterministic", po::bool_switch(&options.deterministic),
+        "split --iterations evenly over the threads and let them take turns, "
+        "so runs with the same seed and thread count produce identical "
+        "strategies.")(
         "handranks", po::value<string>(&options.handranks_path),
         "path to handranks file. (if not installed)")(
         "gamedef,g", po::value<string>(&options.game_definition),
@@ -273,6 +686,20 @@ int parse_options(int argc, char **argv) {
         options.type = holdem;
     }
 
+    if (vm.count("sampler")) {
+      string s = vm["sampler"].as<string>();
+      if (s == "external")
+        options.sampler = EXTERNAL_SAMPLING;
+      else if (s == "chance")
+        options.sampler = CHANCE_SAMPLING;
+      else if (s == "outcome")
+        options.sampler = OUTCOME_SAMPLING;
+      else if (s == "cfrplus")
+        options.sampler = CFR_PLUS_SAMPLING;
+      else if (s == "dcfr")
+        options.sampler = DISCOUNTED_SAMPLING;
+    }
+
     if (vm.count("card-abstraction")) {
       string ca = vm["card-abstraction"].as<string>();
       if (ca == "null")
@@ -289,10 +716,42 @@ int parse_options(int argc, char **argv) {
         options.action_abs = POTRELACTION_ABS;
     }
 
+    if (vm.count("update-mode")) {
+      string um = vm["update-mode"].as<string>();
+      if (um == "hogwild")
+        options.update = HOGWILD_UPDATE;
+      else if (um == "atomic")
+        options.update = ATOMIC_UPDATE;
+      else if (um == "striped")
+        options.update = STRIPED_UPDATE;
+      else if (um == "delta")
+        options.update = DELTA_UPDATE;
+    }
+
+    if (vm.count("compress-strategy")) {
+      string c = vm["compress-strategy"].as<string>();
+      if (c == "none")
+        options.compression = NO_COMPRESSION;
+      else if (c == "lossless")
+        options.compression = LOSSLESS_COMPRESSION;
+      else if (c == "float")
+        options.compression = FLOAT_COMPRESSION;
+    }
+
     if (vm.count("help")) {
       cout << desc << "\n";
       return 1;
     }
+
+    if (options.delta_checkpoints > 0 && options.sync_checkpoint) {
+      cout << "delta checkpoints need asynchronous checkpoints.\n";
+      return 1;
+    }
+
+    if (options.deterministic && options.nb_target_iterations == 0) {
+      cout << "deterministic mode needs the number of iterations.\n";
+      return 1;
+    }
   }
   catch (exception &e) {
     std::cout << e.what() << "\n";
@@ -303,6 +762,78 @@ int parse_options(int argc, char **argv) {
   return 0;
 }
 
+template <class S, class G, class... Args>
+CFRM *specialize_card_abstraction(AbstractGame *game, Args... args) {
+  switch (options.card_abs) {
+  case NULLCARD_ABS:
+    return new SpecializedSampler<S, G, NullCardAbstraction>(game, args...);
+  case BLINDCARD_ABS:
+    return new SpecializedSampler<S, G, BlindCardAbstraction>(game, args...);
+  case CLUSTERCARD_ABS:
+    return new SpecializedSampler<S, G, ClusterCardAbstraction>(game, args...);
+  };
+  throw std::runtime_error("unknown card abstraction");
+}
+
+// instantiates sampler S for the configured game and card abstraction, or
+// the virtually dispatched S with --generic.
+template <class S, class... Args>
+CFRM *specialize(AbstractGame *game, Args... args) {
+  if (options.generic)
+    return new S(game, args...);
+  switch (options.type) {
+  case kuhn:
+    return specialize_card_abstraction<S, KuhnGame>(game, args...);
+  case leduc:
+    return specialize_card_abstraction<S, LeducGame>(game, args...);
+  case holdem:
+    return specialize_card_abstraction<S, HoldemGame>(game, args...);
+  };
+  throw std::runtime_error("unknown game");
+}
+
+template <class T>
+CFRM *create_sampler(AbstractGame *game, string init_strategy) {
+  if (init_strategy == "")
+    return specialize<T>(game);
+  return specialize<T>(game, (char *)init_strategy.c_str());
+}
+
+CFRM *load_sampler(sampler_t sampler, AbstractGame *game,
+                   string init_strategy) {
+  switch (sampler) {
+  case EXTERNAL_SAMPLING: {
+    ExternalSamplingCFR *cfr =
+        (ExternalSamplingCFR *)create_sampler<ExternalSamplingCFR>(
+            game, init_strategy);
+    cfr->prune_threshold = options.prune_threshold;
+    cfr->prune_interval = std::max<size_t>(options.prune_interval, 1);
+    return cfr;
+  }
+  case CHANCE_SAMPLING:
+    return create_sampler<ChanceSamplingCFR>(game, init_strategy);
+  case OUTCOME_SAMPLING:
+    return create_sampler<OutcomeSamplingCFR>(game, init_strategy);
+  case CFR_PLUS_SAMPLING: {
+    ChanceSamplingCFRPlus *cfr =
+        (ChanceSamplingCFRPlus *)create_sampler<ChanceSamplingCFRPlus>(
+            game, init_strategy);
+    cfr->averaging_delay = options.averaging_delay;
+    return cfr;
+  }
+  case DISCOUNTED_SAMPLING:
+    if (init_strategy == "")
+      return specialize<DiscountedCFR>(game, options.dcfr_alpha,
+                                       options.dcfr_beta, options.dcfr_gamma,
+                                       options.discount_interval);
+    return specialize<DiscountedCFR>(game, (char *)init_strategy.c_str(),
+                                     options.dcfr_alpha, options.dcfr_beta,
+                                     options.dcfr_gamma,
+                                     options.discount_interval);
+  };
+  throw std::runtime_error("unknown sampler");
+}
+
 void read_game(char *game_definition) {
   FILE *file = fopen(game_definition, "r");
   if (file == NULL) {
@@ -322,3 +853,195 @@ template <class T> std::string comma_format(T value) {
   ss << std::fixed << value;
   return ss.str();
 }
+
+// evaluates tables and writes them to checkfile. cfr is the running sampler,
+// tables is either cfr or a snapshot of it. with delta set only the regions
+// that changed in that snapshot are written.
+void checkpoint(CFRM *tables, CFRM *cfr, size_t iterations,
+                std::string checkfile, const Snapshot *delta) {
+  if (options.print_best_response) {
+    vector<double> br = tables->best_response(
+        options.nb_br_threads > 0 ? options.nb_br_threads : options.nb_threads);
+    cout << "BR :" << br[0] << " + " << br[1] << " = " << br[0] + br[1]
+         << "\n";
+  }
+
+  if (options.print_abstract_best_response) {
+    vector<double> br = tables->abstract_best_response();
+    cout << "ABR :" << br[0] << " + " << br[1] << " = " << br[0] + br[1]
+         << "\n";
+  }
+
+  if (checkfile != "" && delta) {
+    cout << "Saving " << delta->changed_regrets.size() << " + "
+         << delta->changed_avg.size() << " of "
+         << 2 * delta->regrets.regions() << " changed regions to " << checkfile
+         << "...\n";
+    write_delta(checkfile, delta->regrets, delta->avg_strategy,
+                delta->changed_regrets, delta->changed_avg);
+  } else if (checkfile != "") {
+    cout << "Saving current strategy to " << checkfile << "...\n";
+    tables->dump((char *)checkfile.c_str());
+  }
+
+  std::cout << "#iterations: " << comma_format(iterations) << "\n";
+  if (options.sampler == EXTERNAL_SAMPLING && options.prune_threshold < 0)
+    std::cout << "pruned: "
+              << 100 * ((ExternalSamplingCFR *)cfr)->pruned_fraction()
+              << "%\n";
+}
+
+// reach of the rows of the average strategy if rows are pruned, empty
+// otherwise. prints what pruning saves per round.
+std::vector<double> policy_reach(CFRM *cfr, AbstractGame *game) {
+  std::vector<double> reach;
+  double threshold = options.policy_reach_threshold;
+  if (threshold > 0) {
+    auto start = ch::steady_clock::now();
+    cout << "estimating the reach of the rows with seed: "
+         << options.policy_seed << "\n";
+    nbgen rng = make_rng_stream(options.policy_seed, 0);
+    // branches below a tenth of the threshold hardly change the estimate of
+    // rows above it.
+    reach = cfr->row_reach(options.policy_deals, threshold / 10, rng);
+    cout << "estimated the reach of " << comma_format(reach.size())
+         << " rows from " << comma_format(options.policy_deals)
+         << " deals in "
+         << ch::duration<double>(ch::steady_clock::now() - start).count()
+         << "s\n";
+
+    const FlatTree &tree = game->flat_game_tree();
+    vector<int> infoset_round(game->get_nb_infosets(), 0);
+    for (size_t n = 0; n < tree.size(); ++n)
+      if (tree.nodes[n].type == FLAT_INFOSET)
+        infoset_round[tree.nodes[n].info_idx] = tree.nodes[n].round;
+
+    int nb_rounds = game->nb_rounds();
+    vector<size_t> rows(nb_rounds, 0), pruned(nb_rounds, 0);
+    vector<int64_t> saved(nb_rounds, 0);
+    size_t bytes = options.policy_bits / 8, mask_bytes = 0;
+    for (size_t i = 0; i < cfr->avg_strategy.size(); ++i) {
+      entry_t e = cfr->avg_strategy[i];
+      int r = infoset_round[i];
+      size_t nb_pruned = 0;
+      for (unsigned b = 0; b < e.nb_buckets; ++b)
+        if (reach[cfr->avg_strategy.row_index(i, b)] < threshold)
+          ++nb_pruned;
+      rows[r] += e.nb_buckets;
+      pruned[r] += nb_pruned;
+      mask_bytes += (e.nb_buckets + 63) / 64 * sizeof(uint64_t);
+      // the pruned rows are replaced by one fallback row.
+      if (nb_pruned > 0)
+        saved[r] += (int64_t)(nb_pruned - 1) * e.nb_entries * bytes;
+    }
+    for (int r = 0; r < nb_rounds; ++r)
+      cout << "round " << r << ": pruned " << comma_format(pruned[r])
+           << " of " << comma_format(rows[r]) << " rows, saved "
+           << comma_format(saved[r]) << " bytes\n";
+    cout << "bucket masks: " << comma_format(mask_bytes) << " bytes\n";
+  }
+  return reach;
+}
+
+void export_policy(CFRM *cfr, const std::vector<double> &reach) {
+  write_policy(options.export_policy, cfr->avg_strategy, options.policy_bits,
+               reach, options.policy_reach_threshold);
+  std::ifstream file(options.export_policy.c_str(),
+                     std::ios::binary | std::ios::ate);
+  cout << "wrote " << options.export_policy << " with "
+       << comma_format((size_t)file.tellg()) << " bytes\n";
+}
+
+void export_bundle(CFRM *cfr, AbstractGame *game, CardAbstraction *card_abs,
+                   const std::vector<double> &reach) {
+  game->index_action_sequences();
+  write_bundle(options.export_bundle, gamedef, options.card_abs,
+               options.card_abs_param, card_abs, game->flat_game_tree(),
+               cfr->avg_strategy, options.policy_bits, reach,
+               options.policy_reach_threshold);
+  std::ifstream file(options.export_bundle.c_str(),
+                     std::ios::binary | std::ios::ate);
+  cout << "wrote " << options.export_bundle << " with "
+       << comma_format((size_t)file.tellg()) << " bytes\n";
+}
+
+// bytes of a node of the pointer based tree including its heap buffers.
+size_t node_bytes(INode *node) {
+  if (node->is_terminal()) {
+    if (node->is_fold())
+      return sizeof(FoldNode) + ((FoldNode *)node)->board.capacity();
+    return sizeof(ShowdownNode) + ((ShowdownNode *)node)->board.capacity();
+  }
+  InformationSetNode *n = (InformationSetNode *)node;
+  size_t sum = sizeof(InformationSetNode) + n->board.capacity() +
+               n->children.capacity() * sizeof(INode *);
+  for (unsigned i = 0; i < n->children.size(); ++i)
+    sum += node_bytes(n->children[i]);
+  return sum;
+}
+
+// visits every node and reads what a sampler reads there. returns a
+// checksum so the traversal can not be optimized away.
+double walk_tree(INode *node, size_t &nb_nodes) {
+  ++nb_nodes;
+  if (node->is_terminal()) {
+    if (node->is_fold())
+      return ((FoldNode *)node)->value * (node->get_player() + 1);
+    return ((ShowdownNode *)node)->value;
+  }
+  InformationSetNode *n = (InformationSetNode *)node;
+  double sum = n->get_idx() + n->get_player() + n->get_round();
+  const vector<INode *> &children = n->get_children();
+  for (unsigned i = 0; i < children.size(); ++i)
+    sum += walk_tree(children[i], nb_nodes);
+  return sum;
+}
+
+double walk_tree(const FlatTree &tree, const FlatNode *node,
+                 size_t &nb_nodes) {
+  ++nb_nodes;
+  if (node->is_terminal()) {
+    if (node->is_fold())
+      return node->value * (node->player + 1);
+    return node->value;
+  }
+  double sum = node->info_idx + node->player + node->round;
+  const FlatNode *children = tree.children(node);
+  for (unsigned i = 0; i < node->nb_children; ++i)
+    sum += walk_tree(tree, children + i, nb_nodes);
+  return sum;
+}
+
+// repeats the traversal for at least a second and returns nodes per second.
+template <class F> double nodes_per_second(F walk, double &checksum) {
+  size_t nb_nodes = 0;
+  auto start = ch::steady_clock::now();
+  double elapsed;
+  do {
+    checksum += walk(nb_nodes);
+    elapsed = ch::duration<double>(ch::steady_clock::now() - start).count();
+  } while (elapsed < 1);
+  return nb_nodes / elapsed;
+}
+
+void benchmark_tree(AbstractGame *game) {
+  const FlatTree &flat = game->flat_game_tree();
+  INode *root = game->game_tree_root();
+  double ptr_checksum = 0, flat_checksum = 0;
+
+  double ptr_nps = nodes_per_second(
+      [&](size_t &n) { return walk_tree(root, n); }, ptr_checksum);
+  double flat_nps = nodes_per_second(
+      [&](size_t &n) { return walk_tree(flat, flat.root(), n); },
+      flat_checksum);
+
+  size_t nb_nodes = flat.size();
+  cout << std::fixed << std::setprecision(1);
+  cout << "nodes: " << comma_format(nb_nodes) << "\n";
+  cout << "pointer tree: " << comma_format((size_t)ptr_nps) << " nodes/s, "
+       << (double)node_bytes(root) / nb_nodes << " bytes/node\n";
+  cout << "flat tree:    " << comma_format((size_t)flat_nps) << " nodes/s, "
+       << (double)sizeof(FlatNode) << " bytes/node hot, "
+       << (double)flat.bytes() / nb_nodes << " bytes/node total\n";
+  cout << "speedup: " << flat_nps / ptr_nps << "x\n";
+}
@@ -1,36 +1,82 @@
+#include <cmath>
+#include <cstdint>
+#include <atomic>
+#include <thread>
 #include "cfrm.hpp"
+#include "checkpoint.hpp"
 #include "functions.hpp"
 
-CFRM::CFRM(AbstractGame *game, char *strat_dump_file) : game(game) {
-  std::ifstream file(strat_dump_file, std::ios::in | std::ios::binary);
-  size_t nb_infosets;
-  file.read(reinterpret_cast<char *>(&nb_infosets), sizeof(nb_infosets));
-
-  regrets = entry_c(nb_infosets);
-  for (size_t i = 0; i < nb_infosets; ++i) {
-    entry_t entry;
-    file.read(reinterpret_cast<char *>(&entry.nb_buckets),
-              sizeof(entry.nb_buckets));
-    file.read(reinterpret_cast<char *>(&entry.nb_entries),
-              sizeof(entry.nb_entries));
-    entry.entries = vector<double>(entry.nb_buckets * entry.nb_entries);
-    file.read(reinterpret_cast<char *>(&entry.entries[0]),
-              sizeof(entry.entries[0]) * entry.entries.size());
-    regrets[i] = entry;
-  }
-
-  avg_strategy = entry_c(nb_infosets);
-  for (size_t i = 0; i < nb_infosets; ++i) {
-    entry_t entry;
-    file.read(reinterpret_cast<char *>(&entry.nb_buckets),
-              sizeof(entry.nb_buckets));
-    file.read(reinterpret_cast<char *>(&entry.nb_entries),
-              sizeof(entry.nb_entries));
-    entry.entries = vector<double>(entry.nb_buckets * entry.nb_entries);
-    file.read(reinterpret_cast<char *>(&entry.entries[0]),
-              sizeof(entry.entries[0]) * entry.entries.size());
-    avg_strategy[i] = entry;
+// spin lock per cache line, chosen by the address of the updated row.
+struct alignas(64) update_stripe {
+  std::atomic<bool> locked;
+};
+
+// a buffered update of one value in DELTA_UPDATE mode.
+struct update_delta {
+  entry_value_t *entry;
+  double value;
+  bool floor;
+};
+
+const size_t NB_UPDATE_STRIPES = 4096;
+const size_t DELTA_BUFFER_SIZE = 1 << 12;
+
+static update_stripe update_stripes[NB_UPDATE_STRIPES];
+static thread_local std::vector<update_delta> delta_buffer;
+
+static inline update_stripe &stripe_of(const entry_value_t *row) {
+  return update_stripes[(reinterpret_cast<uintptr_t>(row) >> 6) %
+                        NB_UPDATE_STRIPES];
+}
+
+static inline void lock_stripe(update_stripe &stripe) {
+  while (stripe.locked.exchange(true, std::memory_order_acquire))
+    ;
+}
+
+static inline void unlock_stripe(update_stripe &stripe) {
+  stripe.locked.store(false, std::memory_order_release);
+}
+
+static inline entry_value_t add_value(entry_value_t old, double value,
+                                      bool floor) {
+  entry_value_t sum = old + value;
+  return (floor && sum < 0) ? 0 : sum;
+}
+
+static inline void atomic_add(entry_value_t *entry, double value,
+                              bool floor) {
+  static_assert(sizeof(std::atomic<entry_value_t>) == sizeof(entry_value_t),
+                "atomic entries must have the size of plain entries");
+  std::atomic<entry_value_t> *a =
+      reinterpret_cast<std::atomic<entry_value_t> *>(entry);
+  entry_value_t old = a->load(std::memory_order_relaxed);
+  while (!a->compare_exchange_weak(old, add_value(old, value, floor),
+                                   std::memory_order_relaxed))
+    ;
+}
+
+CFRM::CFRM(AbstractGame *game, char *strat_dump_file)
+    : game(game), tree(game->flat_game_tree()),
+      regrets(game->get_nb_infosets()),
+      avg_strategy(game->get_nb_infosets()),
+      deck(game->generate_deck(game->get_gamedef()->numRanks,
+                               game->get_gamedef()->numSuits)) {
+  if (!is_checkpoint(strat_dump_file)) {
+    std::cout << strat_dump_file << " is in the old dump format, convert it "
+              << "with strategy-tool convert to load it faster.\n";
+    read_legacy_dump(strat_dump_file, regrets, avg_strategy);
+    if (regrets.size() != game->get_nb_infosets())
+      throw std::runtime_error(std::string(strat_dump_file) +
+                               " was written for another game or abstraction");
+    return;
   }
+
+  // only the dimensions are needed to check the fingerprint.
+  game->game_tree_root()->init_entries(
+      regrets, avg_strategy, game->get_gamedef(), game->card_abstraction());
+  read_checkpoint(strat_dump_file, regrets, avg_strategy,
+                  layout_fingerprint(regrets));
 }
 
 std::vector<double> CFRM::abstract_best_response() {
@@ -156,36 +202,43 @@ return result;
 
 }
 
-INode *CFRM::lookup_state(const State *state, int player) {
-  return game->lookup_state(state, player, game->game_tree_root(), 0, 0);
+INode *CFRM::lookup_state(const State *state, int player, nbgen &rng) {
+  std::vector<double> sizes;
+  uint32_t idx = tree.lookup_state(state, sizes, rng);
+  return idx == FlatTree::NO_NODE ? NULL : tree.source[idx];
 }
 
 hand_t CFRM::generate_hand(nbgen &rng) {
-  card_c deck = game->generate_deck(game->get_gamedef()->numRanks,
-                                    game->get_gamedef()->numSuits);
+  hand_t hand;
+  draw_hand(hand, rng);
+
+  CardAbstraction *abs = game->card_abstraction();
+  for (int p = 0; p < game->nb_players(); ++p)
+    abs->map_hand_to_buckets(hand.holes[p], hand.board, game->nb_rounds(),
+                             hand.buckets[p]);
+
+  game->evaluate(hand);
+  return hand;
+}
 
+void CFRM::draw_hand(hand_t &hand, nbgen &rng) {
   uint64_t deckset = -1;
-  int deck_size = game->deck_size();
-  std::vector<card_c> hand(2, card_c(game->hand_size()));
   for (int p = 0; p < game->nb_players(); ++p) {
     for (int c = 0; c < game->hand_size(); ++c) {
-      hand[p][c] = draw_card(deckset, deck, deck.size(), rng);
+      hand.holes[p][c] = draw_card(deckset, deck, deck.size(), rng);
     }
   }
 
-  card_c board;
+  int nb_board = 0;
   for (int r = 0; r < game->nb_rounds(); ++r) {
     for (int i = 0; i < game->nb_boardcards(r); ++i) {
-      board.push_back(draw_card(deckset, deck, deck.size(), rng));
+      hand.board[nb_board++] = draw_card(deckset, deck, deck.size(), rng);
     }
   }
-
-  hand_t handc(hand, board);
-  game->evaluate(handc);
-  return handc;
 }
 
-int CFRM::draw_card(uint64_t &deckset, card_c deck, int deck_size, nbgen &rng) {
+int CFRM::draw_card(uint64_t &deckset, const card_c &deck, int deck_size,
+                    nbgen &rng) {
   using ecalc::bitset;
   int rand;
   while (true) {
@@ -257,22 +310,20 @@ void CFRM::print_strategy_r(unsigned player, INode *curr_node,
   }
 }
 
-std::vector<double> CFRM::get_strategy(uint64_t info_idx, int bucket) {
+unsigned CFRM::get_strategy(uint64_t info_idx, int bucket, double *strategy) {
   entry_t reg = regrets[info_idx];
+  const entry_value_t *r = reg.row(bucket);
   unsigned nb_children = reg.nb_entries;
-  std::vector<double> strategy(nb_children);
   double psum = 0;
 
   for (unsigned i = 0; i < nb_children; ++i)
-    if (reg[bucket * reg.nb_entries + i] > 0) {
-      psum += reg[bucket * reg.nb_entries + i];
+    if (r[i] > 0) {
+      psum += r[i];
     }
 
   if (psum > 0) {
     for (unsigned i = 0; i < nb_children; ++i) {
-      strategy[i] = (reg[bucket * reg.nb_entries + i] > 0)
-                        ? (reg[bucket * reg.nb_entries + i] / psum)
-                        : 0.0;
+      strategy[i] = (r[i] > 0) ? (r[i] / psum) : 0.0;
     }
   } else {
     for (unsigned i = 0; i < nb_children; ++i) {
@@ -280,28 +331,95 @@ std::vector<double> CFRM::get_strategy(uint64_t info_idx, int bucket) {
     }
   }
 
-  return strategy;
+  return nb_children;
+}
+
+int CFRM::sample_strategy(const double *strategy, unsigned nb_choices,
+                          nbgen &rng) {
+  double dart = rng() / (rng.max() + 1.0);
+  for (unsigned i = 0; i < nb_choices; ++i) {
+    if (dart < strategy[i])
+      return i;
+    dart -= strategy[i];
+  }
+  // rounding errors, take the last action that can be played.
+  for (unsigned i = nb_choices - 1; i > 0; --i)
+    if (strategy[i] > 0)
+      return i;
+  return 0;
 }
 
-int CFRM::sample_strategy(std::vector<double> strategy, nbgen &rng) {
-  std::discrete_distribution<int> d(strategy.begin(), strategy.end());
-  return d(rng);
+void CFRM::update_row(entry_value_t *row, const double *values,
+                      unsigned nb_entries, bool floor) {
+  switch (mode) {
+  case HOGWILD_UPDATE:
+    for (unsigned i = 0; i < nb_entries; ++i)
+      row[i] = add_value(row[i], values[i], floor);
+    break;
+  case ATOMIC_UPDATE:
+    for (unsigned i = 0; i < nb_entries; ++i)
+      atomic_add(row + i, values[i], floor);
+    break;
+  case STRIPED_UPDATE: {
+    update_stripe &stripe = stripe_of(row);
+    lock_stripe(stripe);
+    for (unsigned i = 0; i < nb_entries; ++i)
+      row[i] = add_value(row[i], values[i], floor);
+    unlock_stripe(stripe);
+    break;
+  }
+  case DELTA_UPDATE:
+    if (delta_buffer.capacity() < DELTA_BUFFER_SIZE)
+      delta_buffer.reserve(DELTA_BUFFER_SIZE);
+    if (delta_buffer.size() + nb_entries > DELTA_BUFFER_SIZE)
+      flush_updates();
+    for (unsigned i = 0; i < nb_entries; ++i)
+      delta_buffer.push_back({row + i, values[i], floor});
+    // marked when the deltas are merged.
+    return;
+  }
+  mark_dirty(row, nb_entries);
+}
+
+void CFRM::flush_updates() {
+  // deltas of one row are contiguous, lock its stripe once per row.
+  size_t i = 0;
+  while (i < delta_buffer.size()) {
+    update_stripe &stripe = stripe_of(delta_buffer[i].entry);
+    lock_stripe(stripe);
+    do {
+      update_delta &d = delta_buffer[i];
+      *d.entry = add_value(*d.entry, d.value, d.floor);
+      mark_dirty(d.entry, 1);
+      ++i;
+    } while (i < delta_buffer.size() &&
+             &stripe_of(delta_buffer[i].entry) == &stripe);
+    unlock_stripe(stripe);
+  }
+  delta_buffer.clear();
 }
 
 vector<double> CFRM::get_normalized_avg_strategy(uint64_t idx, int bucket) {
+  vector<double> strategy(avg_strategy[idx].nb_entries);
+  normalized_avg_strategy(idx, bucket, strategy.data());
+  return strategy;
+}
+
+void CFRM::normalized_avg_strategy(uint64_t idx, int bucket,
+                                   double *strategy) {
   entry_t avg = avg_strategy[idx];
+  const entry_value_t *a = avg.row(bucket);
   unsigned nb_choices = avg.nb_entries;
-  vector<double> strategy(nb_choices);
   double sum = 0;
 
   for (unsigned i = 0; i < nb_choices; ++i) {
-    double v = avg[bucket * avg.nb_entries + i];
+    double v = a[i];
     sum += (v < 0) ? 0 : v;
   }
 
   if (sum > 0) {
     for (unsigned i = 0; i < nb_choices; ++i) {
-      double v = avg[bucket * avg.nb_entries + i];
+      double v = a[i];
       strategy[i] = (v > 0) ? (v / sum) : 0;
     }
   } else {
@@ -309,8 +427,6 @@ vector<double> CFRM::get_normalized_avg_strategy(uint64_t idx, int bucket) {
       strategy[i] = 1.0 / nb_choices;
     }
   }
-
-  return strategy;
 }
 
 vector<double> CFRM::get_normalized_avg_strategy(uint64_t idx, card_c hand,
@@ -319,404 +435,636 @@ vector<double> CFRM::get_normalized_avg_strategy(uint64_t idx, card_c hand,
   return get_normalized_avg_strategy(idx, bucket);
 }
 
-std::vector<vector<double>> CFRM::br_public_chance(INode *curr_node,
-                                                   vector<vector<double>> op,
-                                                   std::string path) {
-  const Game *def = game->get_gamedef();
-  PublicChanceNode *p = (PublicChanceNode *)curr_node;
-  int nb_dead = p->board.size() + def->numHoleCards;
-  unsigned possible_deals =
-      choose((def->numRanks * def->numSuits) - nb_dead, p->to_deal);
+unsigned CFRM::br_hand_key(const card_c &hand) {
+  unsigned key = 0;
+  for (unsigned c = 0; c < hand.size(); ++c)
+    key = key * MAX_SUITS * MAX_RANKS + hand[c];
+  return key;
+}
 
-  vector<vector<double>> payoffs(op.size(), vector<double>(op[0].size(), 0));
-  card_c deck = bitset_to_deck(game->public_tree_cache[p->hand_idx], 52);
-  hand_list curr_holdings = deck_to_combinations(def->numHoleCards, deck);
-
-  for (unsigned child = 0; child < p->children.size(); ++child) {
-    InformationSetNode *n = (InformationSetNode *)p->children[child];
-    card_c deck = bitset_to_deck(game->public_tree_cache[n->hand_idx], 52);
-    hand_list new_holdings = deck_to_combinations(def->numHoleCards, deck);
-
-    std::string newpath = path;
-    newpath = path + ActionsStr[n->get_action().type] + "/";
-
-    vector<vector<double>> newop(op.size());
-    for (unsigned i = 0; i < op.size(); ++i) {
-      newop[i] = vector<double>(new_holdings.size());
-      for (unsigned j = 0; j < newop[i].size(); ++j) {
-        unsigned idx_hand = game->find_index(new_holdings[j], curr_holdings);
-        newop[i][j] = op[i][idx_hand] / possible_deals;
-      }
-    }
+br_board_t &CFRM::br_board(uint64_t hand_idx) {
+  uint64_t bitset = game->public_tree_cache[hand_idx];
+  auto it = br_boards.find(bitset);
+  if (it != br_boards.end())
+    return it->second;
+
+  br_board_t &b = br_boards[bitset];
+  unsigned nb_cards = game->hand_size();
+  card_c deck = bitset_to_deck(bitset, 52);
+  b.hands = deck_to_combinations(nb_cards, deck);
+
+  unsigned nb_keys = 1;
+  for (unsigned c = 0; c < nb_cards; ++c)
+    nb_keys *= MAX_SUITS * MAX_RANKS;
+  b.index.assign(nb_keys, -1);
+  b.card_count.assign(MAX_SUITS * MAX_RANKS, 0);
+  for (unsigned i = 0; i < b.hands.size(); ++i) {
+    b.index[br_hand_key(b.hands[i])] = i;
+    for (unsigned c = 0; c < nb_cards; ++c)
+      ++b.card_count[b.hands[i][c]];
+  }
+  return b;
+}
 
-    vector<vector<double>> subpayoffs =
-        best_response(p->children[child], newop, newpath);
-    for (unsigned i = 0; i < subpayoffs.size(); ++i) {
-      for (unsigned j = 0; j < subpayoffs[i].size(); ++j) {
-        unsigned idx_hand = game->find_index(new_holdings[j], curr_holdings);
-        payoffs[i][idx_hand] += subpayoffs[i][j];
-      }
+// deck of a public tree node below a chance node. all in hands reach the
+// showdown right after the board is dealt.
+static uint64_t public_hand_idx(INode *node) {
+  if (node->is_fold())
+    return ((FoldNode *)node)->hand_idx;
+  if (node->is_terminal())
+    return ((ShowdownNode *)node)->hand_idx;
+  return ((InformationSetNode *)node)->hand_idx;
+}
+
+void CFRM::prepare_best_response(INode *curr_node, unsigned depth) {
+  br_depth = std::max(br_depth, depth + 1);
+  if (curr_node->is_public_chance()) {
+    PublicChanceNode *p = (PublicChanceNode *)curr_node;
+    br_board(p->hand_idx);
+    for (unsigned i = 0; i < p->children.size(); ++i)
+      prepare_best_response(p->children[i], depth + 1);
+  } else if (curr_node->is_private_chance()) {
+    prepare_best_response(((PrivateChanceNode *)curr_node)->child, depth + 1);
+  } else if (curr_node->is_fold()) {
+    br_board(((FoldNode *)curr_node)->hand_idx);
+  } else if (curr_node->is_terminal()) {
+    ShowdownNode *node = (ShowdownNode *)curr_node;
+    br_board_t &b = br_board(node->hand_idx);
+    if (!b.strength.empty())
+      return;
+    b.strength.resize(b.hands.size());
+    b.order.resize(b.hands.size());
+    for (unsigned i = 0; i < b.hands.size(); ++i) {
+      b.strength[i] = game->hand_strength(b.hands[i], node->board);
+      b.order[i] = i;
     }
+    std::stable_sort(b.order.begin(), b.order.end(),
+                     [&b](unsigned x, unsigned y) {
+                       return b.strength[x] < b.strength[y];
+                     });
+  } else {
+    InformationSetNode *node = (InformationSetNode *)curr_node;
+    br_board_t &b = br_board(node->hand_idx);
+    if (b.buckets.empty()) {
+      b.buckets.resize(b.hands.size());
+      for (unsigned i = 0; i < b.hands.size(); ++i)
+        b.buckets[i] = game->card_abstraction()->map_hand_to_bucket(
+            b.hands[i], node->board, node->get_round());
+    }
+    for (unsigned i = 0; i < node->get_children().size(); ++i)
+      prepare_best_response(node->get_children()[i], depth + 1);
   }
-  return payoffs;
 }
 
-std::vector<vector<double>> CFRM::br_private_chance(INode *curr_node,
-                                                    vector<vector<double>> op,
-                                                    std::string path) {
-  const Game *def = game->get_gamedef();
-  PrivateChanceNode *p = (PrivateChanceNode *)curr_node;
-
-  unsigned possible_deals = choose(def->numRanks * def->numSuits, p->to_deal);
+// number of hands of b that share no card with hand i.
+static double nb_compatible(const br_board_t &b, unsigned i) {
+  double count = b.hands.size();
+  for (unsigned c = 0; c < b.hands[i].size(); ++c)
+    count -= b.card_count[b.hands[i][c]];
+  // with two cards hand i itself was removed twice.
+  return b.hands[i].size() == 2 ? count + 1 : count;
+}
 
-  vector<vector<double>> newop(op.size());
-  for (unsigned i = 0; i < op.size(); ++i) {
-    newop[i] = vector<double>(possible_deals, op[i][0] / possible_deals);
-  }
+// reach of the hands that share no card with hand i, given the total reach
+// and the reach of the hands holding each card. own is the reach of hand i
+// if it is part of the total.
+static double compatible_reach(const card_c &hand, double total,
+                               const double *card_reach, double own) {
+  for (unsigned c = 0; c < hand.size(); ++c)
+    total -= card_reach[hand[c]];
+  return hand.size() == 2 ? total + own : total;
+}
 
-  vector<vector<double>> subpayoffs = best_response(p->child, newop, path);
-  vector<vector<double>> payoffs(op.size(), vector<double>(op[0].size(), 0));
-  for (unsigned i = 0; i < subpayoffs.size(); ++i) {
-    for (unsigned j = 0; j < possible_deals; ++j) {
-      payoffs[i][0] += subpayoffs[i][j];
+// adds sign times the opponent reach of the weaker hands to every hand of b,
+// or of the stronger hands if descending. walks the hands by strength once
+// and keeps the reach per card of the hands already passed.
+static void showdown_sweep(const br_board_t &b, const double *op, double sign,
+                           bool descending, double *values,
+                           vector<double> &card_reach) {
+  std::fill(card_reach.begin(), card_reach.end(), 0);
+  double total = 0;
+  unsigned n = b.order.size();
+  auto hand_at = [&](unsigned k) {
+    return b.order[descending ? n - 1 - k : k];
+  };
+  for (unsigned first = 0; first < n;) {
+    unsigned last = first;
+    int strength = b.strength[hand_at(first)];
+    while (last < n && b.strength[hand_at(last)] == strength)
+      ++last;
+
+    // hands of equal strength split, so none of them is passed yet.
+    for (unsigned k = first; k < last; ++k) {
+      unsigned i = hand_at(k);
+      values[i] +=
+          sign * compatible_reach(b.hands[i], total, card_reach.data(), 0);
+    }
+    for (unsigned k = first; k < last; ++k) {
+      unsigned i = hand_at(k);
+      total += op[i];
+      for (unsigned c = 0; c < b.hands[i].size(); ++c)
+        card_reach[b.hands[i][c]] += op[i];
     }
+    first = last;
   }
+}
 
-  return payoffs;
+// makes buffer hold at least n values. buffers only grow, so after the first
+// best response no node allocates.
+static double *br_buffer(vector<double> &buffer, size_t n) {
+  if (buffer.size() < n)
+    buffer.resize(n);
+  return buffer.data();
 }
 
-std::vector<vector<double>> CFRM::br_terminal(INode *curr_node,
-                                              vector<vector<double>> op,
-                                              std::string path) {
-  unsigned player = 0;
-  unsigned opponent = (player + 1) % 2;
-  vector<vector<double>> payoffs(op.size(), vector<double>(op[0].size(), 0));
-  vector<vector<double>> counts(op.size(), vector<double>(op[0].size(), 0));
+const br_board_t &CFRM::br_cached_board(uint64_t hand_idx) const {
+  return br_boards.at(game->public_tree_cache[hand_idx]);
+}
 
-  if (curr_node->is_fold()) {
-    FoldNode *node = (FoldNode *)curr_node;
-    int fold_player = node->fold_player;
-    vector<vector<vector<int>>> possible_matchups;
-    card_c deck = bitset_to_deck(game->public_tree_cache[node->hand_idx], 52);
-    auto ph = deck_to_combinations(game->get_gamedef()->numHoleCards, deck);
-    auto board = node->board;
-    int money_f = node->value;
+// sums the values of the boards dealt at p into sums, starting with board
+// first and stepping by step. the hands of a board are mapped to the hands
+// before the deal through the hand index.
+void CFRM::br_deal_boards(PublicChanceNode *p, const double *const op[2],
+                          double *const sums[2], unsigned first,
+                          unsigned step, br_workspace_t &ws, unsigned depth) {
+  const Game *def = game->get_gamedef();
+  int nb_dead = p->board.size() + def->numHoleCards;
+  unsigned possible_deals =
+      choose((def->numRanks * def->numSuits) - nb_dead, p->to_deal);
+  const br_board_t &curr = br_cached_board(p->hand_idx);
+  br_frame_t &f = ws.frames[depth];
+
+  std::fill(sums[0], sums[0] + curr.hands.size(), 0);
+  std::fill(sums[1], sums[1] + curr.hands.size(), 0);
+  for (unsigned child = first; child < p->children.size(); child += step) {
+    const br_board_t &next =
+        br_cached_board(public_hand_idx(p->children[child]));
+    unsigned n = next.hands.size();
+
+    f.hand_idx.resize(n);
+    for (unsigned j = 0; j < n; ++j)
+      f.hand_idx[j] = curr.index[br_hand_key(next.hands[j])];
+
+    double *reach[2], *values[2];
+    for (unsigned i = 0; i < 2; ++i) {
+      reach[i] = br_buffer(f.reach[i], n);
+      values[i] = br_buffer(f.values[i], n);
+      for (unsigned j = 0; j < n; ++j)
+        reach[i][j] = op[i][f.hand_idx[j]] / possible_deals;
+    }
 
-    unsigned payoff_idx = 0;
-    for (unsigned i = 0; i < ph.size(); ++i) {
-      for (unsigned j = 0; j < ph.size(); ++j) {
-        if (i == j || game->do_intersect(ph[i], ph[j]))
-          continue;
+    best_response(p->children[child], reach, values, ws, depth + 1);
+    for (unsigned i = 0; i < 2; ++i)
+      for (unsigned j = 0; j < n; ++j)
+        sums[i][f.hand_idx[j]] += values[i][j];
+  }
+}
 
-        double payoff[2] = {(fold_player == 0 ? -1.0 : 1.0) * money_f,
-                            (fold_player == 1 ? -1.0 : 1.0) * money_f};
-
-        unsigned idx_player_hand, idx_opp_hand;
-        double player_prob = 1.0;
-        double opp_prob = 1.0;
-
-        hand_list combo{ph[i], ph[j]};
-        for (unsigned h = 0; h < combo.size(); ++h) {
-          unsigned idx_hand = game->find_index(combo[h], ph);
-          if (h == player) {
-            idx_player_hand = idx_hand;
-            player_prob *= op[h][idx_hand];
-          } else {
-            idx_opp_hand = idx_hand;
-            opp_prob *= op[h][idx_hand];
-          }
-        }
+br_pool_t::br_pool_t(unsigned nb_threads, unsigned depth)
+    : workspaces(nb_threads), threads(nb_threads) {
+  for (unsigned t = 0; t < nb_threads; ++t) {
+    workspaces[t].frames.resize(depth);
+    threads[t] = std::thread([this, t] {
+      uint64_t done = 0;
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true) {
+        cv.wait(lock, [&] { return stop || generation != done; });
+        if (stop)
+          return;
+        done = generation;
+        lock.unlock();
+        (*job)(t);
+        lock.lock();
+        if (--nb_running == 0)
+          cv.notify_all();
+      }
+    });
+  }
+}
 
-        payoffs[player][idx_player_hand] += opp_prob * payoff[player];
-        payoffs[opponent][idx_opp_hand] += player_prob * payoff[opponent];
-        counts[player][idx_player_hand]++;
-        counts[opponent][idx_opp_hand]++;
+br_pool_t::~br_pool_t() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+    cv.notify_all();
+  }
+  for (unsigned t = 0; t < threads.size(); ++t)
+    threads[t].join();
+}
 
-        payoff_idx++;
-      }
-    }
-    for (unsigned c = 0; c < counts.size(); ++c) {
-      for (unsigned d = 0; d < counts[c].size(); ++d) {
-        if (counts[c][d] > 0) {
-          payoffs[c][d] /= (counts[c][d] * 1.0);
-        }
-      }
-    }
+void br_pool_t::run(const std::function<void(unsigned)> &job) {
+  std::unique_lock<std::mutex> lock(mutex);
+  this->job = &job;
+  nb_running = threads.size();
+  ++generation;
+  cv.notify_all();
+  cv.wait(lock, [this] { return nb_running == 0; });
+  this->job = NULL;
+}
 
-    return payoffs;
+// the first chance node reached with a pool splits its boards over the
+// threads of the pool. each thread sums its boards into its own buffers,
+// which are added in thread order, so the result does not depend on the
+// scheduling. chance nodes further down run on the thread that reached them.
+void CFRM::br_public_chance(INode *curr_node, const double *const op[2],
+                            double *const values[2], br_workspace_t &ws,
+                            unsigned depth) {
+  PublicChanceNode *p = (PublicChanceNode *)curr_node;
+  if (!ws.pool) {
+    br_deal_boards(p, op, values, 0, 1, ws, depth);
+    return;
   }
 
-  // showdown
-  ShowdownNode *node = (ShowdownNode *)curr_node;
+  unsigned n = br_cached_board(p->hand_idx).hands.size();
+  vector<br_workspace_t> &pool = ws.pool->workspaces;
+  ws.pool->run([&](unsigned t) {
+    double *sums[2] = {br_buffer(pool[t].sums[0], n),
+                       br_buffer(pool[t].sums[1], n)};
+    br_deal_boards(p, op, sums, t, pool.size(), pool[t], depth);
+  });
+
+  for (unsigned i = 0; i < 2; ++i) {
+    std::fill(values[i], values[i] + n, 0);
+    for (unsigned t = 0; t < pool.size(); ++t)
+      for (unsigned j = 0; j < n; ++j)
+        values[i][j] += pool[t].sums[i][j];
+  }
+}
 
-  vector<vector<vector<int>>> possible_matchups;
-  card_c deck = bitset_to_deck(game->public_tree_cache[node->hand_idx], 52);
-  auto ph = deck_to_combinations(game->get_gamedef()->numHoleCards, deck);
-  unsigned payoff_idx = 0;
-  int money = node->value;
+void CFRM::br_private_chance(INode *curr_node, const double *const op[2],
+                             double *const values[2], br_workspace_t &ws,
+                             unsigned depth) {
+  const Game *def = game->get_gamedef();
+  PrivateChanceNode *p = (PrivateChanceNode *)curr_node;
+  unsigned possible_deals = choose(def->numRanks * def->numSuits, p->to_deal);
+  br_frame_t &f = ws.frames[depth];
 
-  for (unsigned i = 0; i < ph.size(); ++i) {
-    for (unsigned j = 0; j < ph.size(); ++j) {
-      if (i == j || game->do_intersect(ph[i], ph[j]))
-        continue;
-
-      hand_t hand({ph[i], ph[j]}, node->board);
-      game->evaluate(hand);
-      double payoff[2] = {(double)hand.value[0] * money,
-                          (double)hand.value[1] * money};
-
-      unsigned idx_player_hand, idx_opp_hand;
-      double player_prob = 1.0;
-      double opp_prob = 1.0;
-
-      hand_list combo{ph[i], ph[j]};
-      for (unsigned h = 0; h < combo.size(); ++h) {
-        unsigned idx_hand = game->find_index(combo[h], ph);
-        if (h == player) {
-          idx_player_hand = idx_hand;
-          player_prob *= op[h][idx_hand];
-        } else {
-          idx_opp_hand = idx_hand;
-          opp_prob *= op[h][idx_hand];
-        }
-      }
+  double *reach[2], *subvalues[2];
+  for (unsigned i = 0; i < 2; ++i) {
+    reach[i] = br_buffer(f.reach[i], possible_deals);
+    subvalues[i] = br_buffer(f.values[i], possible_deals);
+    std::fill(reach[i], reach[i] + possible_deals, op[i][0] / possible_deals);
+  }
 
-      payoffs[player][idx_player_hand] += opp_prob * payoff[player];
-      payoffs[opponent][idx_opp_hand] += player_prob * payoff[opponent];
-      counts[player][idx_player_hand]++;
-      counts[opponent][idx_opp_hand]++;
+  best_response(p->child, reach, subvalues, ws, depth + 1);
+  for (unsigned i = 0; i < 2; ++i) {
+    values[i][0] = 0;
+    for (unsigned j = 0; j < possible_deals; ++j)
+      values[i][0] += subvalues[i][j];
+  }
+}
 
-      payoff_idx++;
-    }
+// the payoff of a hand is averaged over the opponent hands that share no
+// card with it. folds need the total opponent reach minus the reach of the
+// hands holding one of its cards, showdowns the same over the weaker and the
+// stronger hands, so both are linear in the number of hands.
+void CFRM::br_terminal(INode *curr_node, const double *const op[2],
+                       double *const values[2], br_workspace_t &ws) {
+  uint64_t hand_idx;
+  int money;
+  int fold_player = -1;
+  if (curr_node->is_fold()) {
+    FoldNode *node = (FoldNode *)curr_node;
+    hand_idx = node->hand_idx;
+    money = node->value;
+    fold_player = node->fold_player;
+  } else {
+    ShowdownNode *node = (ShowdownNode *)curr_node;
+    hand_idx = node->hand_idx;
+    money = node->value;
   }
-  for (unsigned c = 0; c < counts.size(); ++c) {
-    for (unsigned d = 0; d < counts[c].size(); ++d) {
-      if (counts[c][d] > 0) {
-        payoffs[c][d] /= (counts[c][d] * 1.0);
+
+  const br_board_t &b = br_cached_board(hand_idx);
+  unsigned n = b.hands.size();
+  vector<double> &card_reach = ws.card_reach;
+  card_reach.resize(MAX_SUITS * MAX_RANKS);
+  for (unsigned p = 0; p < 2; ++p) {
+    const double *opp = op[1 - p];
+    double *v = values[p];
+    std::fill(v, v + n, 0);
+
+    if (fold_player >= 0) {
+      std::fill(card_reach.begin(), card_reach.end(), 0);
+      double total = 0;
+      for (unsigned j = 0; j < n; ++j) {
+        total += opp[j];
+        for (unsigned c = 0; c < b.hands[j].size(); ++c)
+          card_reach[b.hands[j][c]] += opp[j];
       }
+      double payoff = (fold_player == (int)p ? -1.0 : 1.0) * money;
+      for (unsigned i = 0; i < n; ++i)
+        v[i] = payoff * compatible_reach(b.hands[i], total, card_reach.data(),
+                                         opp[i]);
+    } else {
+      showdown_sweep(b, opp, money, false, v, card_reach);
+      showdown_sweep(b, opp, -money, true, v, card_reach);
     }
-  }
 
-  return payoffs;
+    for (unsigned i = 0; i < n; ++i) {
+      double count = nb_compatible(b, i);
+      if (count > 0)
+        v[i] /= count;
+    }
+  }
 }
 
-std::vector<vector<double>> CFRM::br_infoset(INode *curr_node,
-                                             vector<vector<double>> op,
-                                             std::string path) {
+void CFRM::br_infoset(INode *curr_node, const double *const op[2],
+                      double *const values[2], br_workspace_t &ws,
+                      unsigned depth) {
   InformationSetNode *node = (InformationSetNode *)curr_node;
   uint64_t info_idx = node->get_idx();
-  int nb_buckets = game->card_abstraction()->get_nb_buckets(game->get_gamedef(),
-                                                            node->get_round());
+  const br_board_t &b = br_cached_board(node->hand_idx);
+  const vector<INode *> &children = node->get_children();
+  unsigned n = b.hands.size(), nb_actions = children.size();
+  unsigned player = node->get_player(), opponent = 1 - player;
+  br_frame_t &f = ws.frames[depth];
+
+  double *strategy = br_buffer(f.strategy, n * nb_actions);
+  for (unsigned j = 0; j < n; ++j)
+    normalized_avg_strategy(info_idx, b.buckets[j], strategy + j * nb_actions);
+
+  double *reach = br_buffer(f.reach[player], n);
+  double *subvalues[2] = {br_buffer(f.values[0], n),
+                          br_buffer(f.values[1], n)};
+  const double *subop[2];
+  subop[player] = reach;
+  subop[opponent] = op[opponent];
+
+  // the best response picks the best action per hand, the opponent's values
+  // are summed over the actions of the strategy.
+  std::fill(values[player], values[player] + n, DOUBLE_MAX * -1);
+  std::fill(values[opponent], values[opponent] + n, 0);
+  for (unsigned a = 0; a < nb_actions; ++a) {
+    for (unsigned j = 0; j < n; ++j)
+      reach[j] = op[player][j] * strategy[j * nb_actions + a];
+
+    best_response(children[a], subop, subvalues, ws, depth + 1);
+    for (unsigned j = 0; j < n; ++j) {
+      if (subvalues[player][j] > values[player][j])
+        values[player][j] = subvalues[player][j];
+      values[opponent][j] += subvalues[opponent][j];
+    }
+  }
+}
 
-  card_c deck = bitset_to_deck(game->public_tree_cache[node->hand_idx],
-                               52); // todo variable
-  hand_list combos =
-      deck_to_combinations(game->get_gamedef()->numHoleCards, deck);
-  vector<vector<double>> probabilities(combos.size());
+void CFRM::best_response(INode *curr_node, const double *const op[2],
+                         double *const values[2], br_workspace_t &ws,
+                         unsigned depth) {
+  if (curr_node->is_public_chance()) {
+    br_public_chance(curr_node, op, values, ws, depth);
+  } else if (curr_node->is_private_chance()) {
+    br_private_chance(curr_node, op, values, ws, depth);
+  } else if (curr_node->is_terminal()) {
+    br_terminal(curr_node, op, values, ws);
+  } else {
+    br_infoset(curr_node, op, values, ws, depth);
+  }
+}
 
-  for (unsigned i = 0; i < op[0].size(); ++i) {
-    auto hand = combos[i];
-    probabilities[i] = get_normalized_avg_strategy(info_idx, hand, node->board,
-                                                   node->get_round());
+std::vector<double> CFRM::best_response(int nb_threads) {
+  // the card removal of compatible_reach only corrects single overlaps.
+  if (game->hand_size() > 2)
+    throw std::runtime_error("best response supports at most two hole cards");
+  if (br_boards.empty())
+    prepare_best_response(game->public_tree_root(), 0);
+
+  br_workspace_t ws;
+  ws.frames.resize(br_depth);
+  std::unique_ptr<br_pool_t> pool;
+  if (nb_threads > 1) {
+    pool.reset(new br_pool_t(nb_threads, br_depth));
+    ws.pool = pool.get();
   }
 
-  vector<vector<vector<double>>> action_payoffs(node->get_children().size());
-  for (unsigned i = 0; i < node->get_children().size(); ++i) {
-    vector<vector<double>> newop(op);
-    for (unsigned j = 0; j < probabilities.size(); ++j) {
-      newop[node->get_player()][j] *= probabilities[j][i];
-    }
-    std::string newpath = path;
-    if (!node->get_children()[i]->is_chance())
-      newpath = path + ActionsStr[node->get_children()[i]->get_action().type];
-    action_payoffs[i] = best_response(node->get_children()[i], newop, newpath);
-  }
-
-  vector<vector<double>> payoffs(op.size());
-  for (unsigned i = 0; i < op.size(); ++i) {
-    if (i == node->get_player()) {
-      payoffs[i] = vector<double>(op[i].size(), 0);
-      for (unsigned j = 0; j < op[i].size(); ++j) {
-        double max_value = DOUBLE_MAX * -1;
-        for (unsigned action = 0; action < action_payoffs.size(); ++action) {
-          double value = action_payoffs[action][i][j];
-          if (value > max_value) {
-            max_value = value;
-          }
-        }
-        payoffs[i][j] = max_value;
-      }
-    } else {
-      payoffs[i] = vector<double>(op[i].size(), 0);
-      for (unsigned j = 0; j < op[i].size(); ++j) {
-        for (unsigned action = 0; action < action_payoffs.size(); ++action) {
-          if (action_payoffs[action][i].size() == 0)
-            continue;
-          payoffs[i][j] += action_payoffs[action][i][j];
-        }
+  double reach[2] = {1.0, 1.0}, result[2];
+  const double *op[2] = {&reach[0], &reach[1]};
+  double *values[2] = {&result[0], &result[1]};
+  best_response(game->public_tree_root(), op, values, ws, 0);
+  return std::vector<double>(result, result + 2);
+}
+
+std::vector<double> CFRM::row_reach(size_t nb_deals, double cutoff,
+                                    nbgen &rng) {
+  std::vector<double> reach(avg_strategy.rows(), 0);
+  for (size_t d = 0; d < nb_deals; ++d)
+    accumulate_reach(tree.root(), generate_hand(rng), 1, cutoff, reach);
+  for (size_t i = 0; i < reach.size(); ++i)
+    reach[i] /= nb_deals;
+  return reach;
+}
+
+void CFRM::accumulate_reach(const FlatNode *node, const hand_t &hand,
+                            double reach, double cutoff,
+                            std::vector<double> &reach_sum) {
+  if (node->is_terminal() || reach < cutoff)
+    return;
+  int bucket = hand.buckets[node->player][node->round];
+  reach_sum[avg_strategy.row_index(node->info_idx, bucket)] += reach;
+
+  const entry_value_t *a = avg_strategy[node->info_idx].row(bucket);
+  double sum = 0;
+  for (unsigned i = 0; i < node->nb_children; ++i)
+    sum += a[i] > 0 ? a[i] : 0;
+  const FlatNode *children = tree.children(node);
+  for (unsigned i = 0; i < node->nb_children; ++i) {
+    double p = sum > 0 ? (a[i] > 0 ? a[i] / sum : 0) : 1.0 / node->nb_children;
+    accumulate_reach(children + i, hand, reach * p, cutoff, reach_sum);
+  }
+}
+
+void CFRM::dump(char *filename) {
+  if (compression == NO_COMPRESSION)
+    write_checkpoint(filename, regrets, avg_strategy);
+  else
+    write_compressed_checkpoint(filename, regrets, avg_strategy,
+                                compression == FLOAT_COMPRESSION);
+}
+
+// values copied between two fences when a snapshot is taken.
+const size_t SNAPSHOT_CHUNK_VALUES = (1 << 20) / sizeof(entry_value_t);
+
+// copies from into to and, if take_flags, collects the regions of from that
+// are flagged dirty now or were in the previous copy.
+static void copy_store(entry_c &from, entry_c &to,
+                       std::vector<uint64_t> &changed,
+                       std::vector<bool> &recent, bool take_flags = true) {
+  const std::vector<entry_c::layout_t> &fl = from.get_layout();
+  const std::vector<entry_c::layout_t> &tl = to.get_layout();
+  bool same_layout = from.values() == to.values() && fl.size() == tl.size();
+  for (size_t i = 0; same_layout && i < fl.size(); ++i)
+    same_layout = fl[i].offset == tl[i].offset && fl[i].stride == tl[i].stride;
+  // a strategy loaded from a file may use another row alignment. the
+  // snapshot takes over its layout, so regions mean the same in both.
+  if (!same_layout)
+    to = from;
+
+  const size_t region = entry_c::REGION_VALUES;
+  changed.clear();
+  take_flags = take_flags && from.tracks_dirty();
+  if (take_flags)
+    recent.resize(from.regions());
+  for (size_t i = 0; i < from.values(); i += SNAPSHOT_CHUNK_VALUES) {
+    size_t n = std::min(SNAPSHOT_CHUNK_VALUES, from.values() - i);
+    if (take_flags) {
+      // chunks are multiples of a region.
+      for (size_t r = i / region; r < (i + n + region - 1) / region; ++r) {
+        bool dirty = from.take_dirty(r);
+        if (dirty || recent[r])
+          changed.push_back(r);
+        recent[r] = dirty;
       }
     }
+    memcpy(to.data() + i, from.data() + i, n * sizeof(entry_value_t));
   }
+}
 
-  return payoffs;
+void Snapshot::copy_from(CFRM &cfr) {
+  copy_store(cfr.regrets, regrets, changed_regrets, recent_regrets);
+  copy_store(cfr.avg_strategy, avg_strategy, changed_avg, recent_avg);
 }
 
-std::vector<vector<double>> CFRM::best_response(INode *curr_node,
-                                                vector<vector<double>> op,
-                                                std::string path) {
-  if (curr_node->is_public_chance()) {
-    return br_public_chance(curr_node, op, path);
-  } else if (curr_node->is_private_chance()) {
-    return br_private_chance(curr_node, op, path);
-  } else if (curr_node->is_terminal()) {
-    return br_terminal(curr_node, op, path);
-  }
-  return br_infoset(curr_node, op, path);
+void Snapshot::copy_avg_from(CFRM &cfr) {
+  copy_store(cfr.avg_strategy, avg_strategy, changed_avg, recent_avg, false);
 }
 
-std::vector<double> CFRM::best_response() {
-  auto result =
-      best_response(game->public_tree_root(),
-                    vector<vector<double>>(game->get_gamedef()->numPlayers,
-                                           vector<double>(1, 1.0)),
-                    "");
-  std::vector<double> out(result.size());
-  for (unsigned i = 0; i < result.size(); ++i)
-    out[i] = result[i][0];
-  return out;
+// actions explored and pruned by the calling thread in the current
+// iteration, added to the shared counters once per iteration.
+static thread_local uint64_t local_explored = 0;
+static thread_local uint64_t local_pruned = 0;
+
+void ExternalSamplingCFR::iterate(const hand_t &hand, nbgen &rng) {
+  bool prune = false;
+  if (prune_threshold < 0)
+    prune = nb_iterations.fetch_add(1, std::memory_order_relaxed) %
+                prune_interval != 0;
+  train(0, hand, tree.root(), 1, 1, prune, rng);
+  train(1, hand, tree.root(), 1, 1, prune, rng);
+
+  if (prune_threshold < 0) {
+    nb_explored.fetch_add(local_explored, std::memory_order_relaxed);
+    nb_pruned.fetch_add(local_pruned, std::memory_order_relaxed);
+    local_explored = local_pruned = 0;
+  }
 }
 
-void CFRM::dump(char *filename) {
-  std::ofstream fs(filename, std::ios::out | std::ios::binary);
-  size_t nb_infosets = regrets.size();
-  fs.write(reinterpret_cast<const char *>(&nb_infosets), sizeof(nb_infosets));
-  for (unsigned i = 0; i < nb_infosets; ++i) {
-    fs.write(reinterpret_cast<const char *>(&regrets[i].nb_buckets),
-             sizeof(regrets[i].nb_buckets));
-    fs.write(reinterpret_cast<const char *>(&regrets[i].nb_entries),
-             sizeof(regrets[i].nb_entries));
-    fs.write(reinterpret_cast<const char *>(&regrets[i].entries[0]),
-             sizeof(regrets[i].entries[0]) * (regrets[i].entries.size()));
-  }
-  for (unsigned i = 0; i < nb_infosets; ++i) {
-    fs.write(reinterpret_cast<const char *>(&avg_strategy[i].nb_buckets),
-             sizeof(avg_strategy[i].nb_buckets));
-    fs.write(reinterpret_cast<const char *>(&avg_strategy[i].nb_entries),
-             sizeof(avg_strategy[i].nb_entries));
-    fs.write(reinterpret_cast<const char *>(&avg_strategy[i].entries[0]),
-             sizeof(avg_strategy[i].entries[0]) *
-                 (avg_strategy[i].entries.size()));
-  }
-  fs.close();
-}
-
-void ExternalSamplingCFR::iterate(nbgen &rng) {
-  hand_t hand = generate_hand(rng);
-  train(0, hand, game->game_tree_root(), 1, 1, rng);
-  train(1, hand, game->game_tree_root(), 1, 1, rng);
-}
-
-double ExternalSamplingCFR::train(int trainplayer, hand_t hand,
-                                  INode *curr_node, double p, double op,
-                                  nbgen &rng) {
-  if (curr_node->is_terminal()) {
-    if (curr_node->is_fold()) {
-      FoldNode *node = (FoldNode *)curr_node;
-      if (trainplayer == node->get_player())
+double ExternalSamplingCFR::train(int trainplayer, const hand_t &hand,
+                                  const FlatNode *node, double p, double op,
+                                  bool prune, nbgen &rng) {
+  if (node->is_terminal()) {
+    if (node->is_fold()) {
+      if (trainplayer == node->player)
         return -node->value;
       return node->value;
     }
     // else showdown
-    return hand.value[trainplayer] * ((ShowdownNode *)curr_node)->value;
+    return hand.value[trainplayer] * node->value;
   } else {
-    InformationSetNode *node = (InformationSetNode *)curr_node;
-    uint64_t info_idx = node->get_idx();
-    int bucket = game->card_abstraction()->map_hand_to_bucket(
-        hand.holes[node->get_player()], hand.board, node->get_round());
+    uint64_t info_idx = node->info_idx;
+    int bucket = hand.buckets[node->player][node->round];
+    const FlatNode *children = tree.children(node);
 
-    if (node->get_player() == trainplayer) {
-      auto strategy = get_strategy(node->get_idx(), bucket);
+    double strategy[MAX_ABSTRACT_ACTIONS];
+    unsigned nb_children = get_strategy(info_idx, bucket, strategy);
 
-      entry_t avg = avg_strategy[info_idx];
-      for (unsigned i = 0; i < strategy.size(); ++i)
-        avg_strategy[info_idx][bucket * avg.nb_entries + i] +=
-            (1.0 / op) * p * strategy[i];
+    if (node->player == trainplayer) {
+      double avg[MAX_ABSTRACT_ACTIONS];
+      for (unsigned i = 0; i < nb_children; ++i)
+        avg[i] = (1.0 / op) * p * strategy[i];
+      update_row(avg_strategy[info_idx].row(bucket), avg, nb_children);
 
-      std::vector<double> utils(strategy.size());
+      double utils[MAX_ABSTRACT_ACTIONS];
+      bool explored[MAX_ABSTRACT_ACTIONS];
       double ev = 0;
 
-      for (unsigned i = 0; i < strategy.size(); ++i) {
-        utils[i] = train(trainplayer, hand, node->get_children()[i],
-                         p * strategy[i], op, rng);
+      // every child reads its regret row as soon as it is entered, start
+      // loading all of them before the first subtree is traversed.
+      for (unsigned i = 0; i < nb_children; ++i)
+        prefetch_row(children + i, hand);
+
+      const entry_value_t *reg = regrets[info_idx].row(bucket);
+      for (unsigned i = 0; i < nb_children; ++i) {
+        // only actions the current strategy never plays are pruned, so the
+        // node value stays unbiased. terminal children are cheap anyway.
+        explored[i] = !prune || reg[i] >= prune_threshold ||
+                      strategy[i] > 0 || children[i].is_terminal();
+        if (!explored[i]) {
+          ++local_pruned;
+          continue;
+        }
+        if (prune)
+          ++local_explored;
+        utils[i] = train(trainplayer, hand, children + i, p * strategy[i], op,
+                         prune, rng);
         ev += utils[i] * strategy[i];
       }
 
-      entry_t reg = regrets[info_idx];
-      for (unsigned i = 0; i < strategy.size(); ++i) {
-        regrets[info_idx][bucket * reg.nb_entries + i] += utils[i] - ev;
+      // the regrets of pruned actions stay untouched.
+      for (unsigned i = 0; i < nb_children; ++i) {
+        utils[i] = explored[i] ? utils[i] - ev : 0;
       }
+      update_row(regrets[info_idx].row(bucket), utils, nb_children);
 
       return ev;
     } else {
-      auto strategy = get_strategy(info_idx, bucket);
-      int action = sample_strategy(strategy, rng);
-      return train(trainplayer, hand, node->get_children()[action], p,
-                   op * strategy[action], rng);
+      int action = sample_strategy(strategy, nb_children, rng);
+      return train(trainplayer, hand, children + action, p,
+                   op * strategy[action], prune, rng);
     }
   }
 }
 
-void ChanceSamplingCFR::iterate(nbgen &rng) {
-  hand_t hand = generate_hand(rng);
-  train(0, hand, game->game_tree_root(), 1, 1, rng);
-  train(1, hand, game->game_tree_root(), 1, 1, rng);
+void ChanceSamplingCFR::iterate(const hand_t &hand, nbgen &rng) {
+  train(0, hand, tree.root(), 1, 1, rng);
+  train(1, hand, tree.root(), 1, 1, rng);
 }
 
-double ChanceSamplingCFR::train(int trainplayer, hand_t hand, INode *curr_node,
-                                double p, double op, nbgen &rng) {
-  if (curr_node->is_terminal()) {
-    if (curr_node->is_fold()) {
-      FoldNode *node = (FoldNode *)curr_node;
-      if (trainplayer == node->get_player())
+double ChanceSamplingCFR::train(int trainplayer, const hand_t &hand,
+                                const FlatNode *node, double p, double op,
+                                nbgen &rng) {
+  if (node->is_terminal()) {
+    if (node->is_fold()) {
+      if (trainplayer == node->player)
         return op * -node->value;
       return op * node->value;
     }
     // else showdown
-    return hand.value[trainplayer] * ((ShowdownNode *)curr_node)->value * op;
+    return hand.value[trainplayer] * node->value * op;
   } else {
-    InformationSetNode *node = (InformationSetNode *)curr_node;
-    uint64_t info_idx = node->get_idx();
-    int bucket = game->card_abstraction()->map_hand_to_bucket(
-        hand.holes[node->get_player()], hand.board, node->get_round());
+    uint64_t info_idx = node->info_idx;
+    int bucket = hand.buckets[node->player][node->round];
+    const FlatNode *children = tree.children(node);
 
-    if (node->get_player() == trainplayer) {
-      auto strategy = get_strategy(node->get_idx(), bucket);
+    double strategy[MAX_ABSTRACT_ACTIONS];
+    unsigned nb_children = get_strategy(info_idx, bucket, strategy);
 
-      entry_t avg = avg_strategy[info_idx];
-      for (unsigned i = 0; i < strategy.size(); ++i)
-        avg_strategy[info_idx][bucket * avg.nb_entries + i] += p * strategy[i];
+    if (node->player == trainplayer) {
+      double avg[MAX_ABSTRACT_ACTIONS];
+      for (unsigned i = 0; i < nb_children; ++i)
+        avg[i] = p * strategy[i];
+      update_row(avg_strategy[info_idx].row(bucket), avg, nb_children);
 
-      std::vector<double> utils(strategy.size());
+      double utils[MAX_ABSTRACT_ACTIONS];
       double ev = 0;
 
-      for (unsigned i = 0; i < strategy.size(); ++i) {
-        utils[i] = train(trainplayer, hand, node->get_children()[i],
-                         p * strategy[i], op, rng);
+      for (unsigned i = 0; i < nb_children; ++i)
+        prefetch_row(children + i, hand);
+
+      for (unsigned i = 0; i < nb_children; ++i) {
+        utils[i] = train(trainplayer, hand, children + i, p * strategy[i], op,
+                         rng);
         ev += utils[i] * strategy[i];
       }
 
-      entry_t reg = regrets[info_idx];
-      for (unsigned i = 0; i < strategy.size(); ++i) {
-        regrets[info_idx][bucket * reg.nb_entries + i] += utils[i] - ev;
+      for (unsigned i = 0; i < nb_children; ++i) {
+        utils[i] -= ev;
       }
+      update_row(regrets[info_idx].row(bucket), utils, nb_children);
 
       return ev;
     } else {
-      auto strategy = get_strategy(info_idx, bucket);
       double ev = 0;
-      for (unsigned i = 0; i < strategy.size(); ++i) {
-        ev += train(trainplayer, hand, node->get_children()[i], p,
-                    op * strategy[i], rng);
+      for (unsigned i = 0; i < nb_children; ++i) {
+        ev += train(trainplayer, hand, children + i, p, op * strategy[i], rng);
       }
 
       return ev;
@@ -724,66 +1072,244 @@ double ChanceSamplingCFR::train(int trainplayer, hand_t hand, INode *curr_node,
   }
 }
 
-void OutcomeSamplingCFR::iterate(nbgen &rng) {
-  hand_t hand = generate_hand(rng);
-  train(hand, game->game_tree_root(), vector<double>(2, 1), 1, rng);
+void OutcomeSamplingCFR::iterate(const hand_t &hand, nbgen &rng) {
+  double reach[2] = {1, 1};
+  double values[2];
+  train(hand, tree.root(), reach, 1, rng, values);
 }
 
-vector<double> OutcomeSamplingCFR::train(hand_t hand, INode *curr_node,
-                                         vector<double> reach, double sp,
-                                         nbgen &rng) {
-  if (curr_node->is_terminal()) {
-    if (curr_node->is_fold()) {
-      FoldNode *node = (FoldNode *)curr_node;
-      int foldp = node->get_player();
-      std::vector<double> values{foldp == 0 ? -node->value : node->value,
-                                 foldp == 1 ? -node->value : node->value};
-      return vector<double>{reach[1] * values[0] / sp,
-                            reach[0] * values[1] / sp};
+void OutcomeSamplingCFR::train(const hand_t &hand, const FlatNode *node,
+                               const double *reach, double sp, nbgen &rng,
+                               double *values) {
+  if (node->is_terminal()) {
+    if (node->is_fold()) {
+      int foldp = node->player;
+      values[0] = reach[1] * (foldp == 0 ? -node->value : node->value) / sp;
+      values[1] = reach[0] * (foldp == 1 ? -node->value : node->value) / sp;
+      return;
     }
     // else showdown
     double sdv = hand.value[0];
-    return vector<double>{
-        sdv * reach[1] * ((ShowdownNode *)curr_node)->value / sp,
-        -sdv * reach[0] * ((ShowdownNode *)curr_node)->value / sp};
+    values[0] = sdv * reach[1] * node->value / sp;
+    values[1] = -sdv * reach[0] * node->value / sp;
   } else {
-    InformationSetNode *node = (InformationSetNode *)curr_node;
-    uint64_t info_idx = node->get_idx();
-    int bucket = game->card_abstraction()->map_hand_to_bucket(
-        hand.holes[node->get_player()], hand.board, node->get_round());
+    uint64_t info_idx = node->info_idx;
+    unsigned player = node->player;
+    int bucket = hand.buckets[player][node->round];
 
-    auto strategy = get_strategy(node->get_idx(), bucket);
+    double strategy[MAX_ABSTRACT_ACTIONS];
+    unsigned nb_children = get_strategy(info_idx, bucket, strategy);
 
-    entry_t avg = avg_strategy[info_idx];
-    for (unsigned i = 0; i < strategy.size(); ++i)
-      avg_strategy[info_idx][bucket * avg.nb_entries + i] +=
-          (reach[node->get_player()] * strategy[i]) / sp;
+    double avg[MAX_ABSTRACT_ACTIONS];
+    for (unsigned i = 0; i < nb_children; ++i)
+      avg[i] = (reach[player] * strategy[i]) / sp;
+    update_row(avg_strategy[info_idx].row(bucket), avg, nb_children);
 
     const double exploration = 0.6;
     int sampled_action;
 
-    std::discrete_distribution<int> d{exploration, 1 - exploration};
-    if (d(rng) == 0) {
-      sampled_action = rng() % strategy.size();
+    if (rng() / (rng.max() + 1.0) < exploration) {
+      sampled_action = rng() % nb_children;
     } else {
-      sampled_action = sample_strategy(strategy, rng);
+      sampled_action = sample_strategy(strategy, nb_children, rng);
     }
 
-    reach[node->get_player()] *= strategy[sampled_action];
-    double csp = exploration * (1.0 / strategy.size()) +
+    double new_reach[2] = {reach[0], reach[1]};
+    new_reach[player] *= strategy[sampled_action];
+    double csp = exploration * (1.0 / nb_children) +
                  (1 - exploration) * strategy[sampled_action];
-    auto ev =
-        train(hand, node->get_children()[sampled_action], reach, sp * csp, rng);
+    train(hand, tree.children(node) + sampled_action, new_reach, sp * csp, rng,
+          values);
+
+    double reg[MAX_ABSTRACT_ACTIONS];
+    for (unsigned i = 0; i < nb_children; ++i)
+      reg[i] = -values[player] * strategy[sampled_action];
+    reg[sampled_action] += values[player];
+    values[player] *= strategy[sampled_action];
+    update_row(regrets[info_idx].row(bucket), reg, nb_children);
+  }
+}
 
-    entry_t reg = regrets[info_idx];
-    regrets[info_idx][bucket * reg.nb_entries + sampled_action] +=
-        ev[node->get_player()];
-    ev[node->get_player()] *= strategy[sampled_action];
+void ChanceSamplingCFRPlus::iterate(const hand_t &hand, nbgen &rng) {
+  size_t t = ++nb_iterations;
+  double weight = t > averaging_delay ? t - averaging_delay : 0;
+  train(0, hand, tree.root(), 1, 1, weight, rng);
+  train(1, hand, tree.root(), 1, 1, weight, rng);
+}
 
-    for (unsigned i = 0; i < strategy.size(); ++i) {
-      regrets[info_idx][bucket * reg.nb_entries + i] -= ev[node->get_player()];
+double ChanceSamplingCFRPlus::train(int trainplayer, const hand_t &hand,
+                                    const FlatNode *node, double p, double op,
+                                    double weight, nbgen &rng) {
+  if (node->is_terminal()) {
+    if (node->is_fold()) {
+      if (trainplayer == node->player)
+        return op * -node->value;
+      return op * node->value;
     }
+    // else showdown
+    return hand.value[trainplayer] * node->value * op;
+  } else {
+    uint64_t info_idx = node->info_idx;
+    int bucket = hand.buckets[node->player][node->round];
+    const FlatNode *children = tree.children(node);
+
+    double strategy[MAX_ABSTRACT_ACTIONS];
+    unsigned nb_children = get_strategy(info_idx, bucket, strategy);
+
+    if (node->player == trainplayer) {
+      if (weight > 0) {
+        double avg[MAX_ABSTRACT_ACTIONS];
+        for (unsigned i = 0; i < nb_children; ++i)
+          avg[i] = weight * p * strategy[i];
+        update_row(avg_strategy[info_idx].row(bucket), avg, nb_children);
+      }
 
-    return ev;
+      double utils[MAX_ABSTRACT_ACTIONS];
+      double ev = 0;
+
+      for (unsigned i = 0; i < nb_children; ++i)
+        prefetch_row(children + i, hand);
+
+      for (unsigned i = 0; i < nb_children; ++i) {
+        utils[i] = train(trainplayer, hand, children + i, p * strategy[i], op,
+                         weight, rng);
+        ev += utils[i] * strategy[i];
+      }
+
+      for (unsigned i = 0; i < nb_children; ++i) {
+        utils[i] -= ev;
+      }
+      update_row(regrets[info_idx].row(bucket), utils, nb_children, true);
+
+      return ev;
+    } else {
+      double ev = 0;
+      for (unsigned i = 0; i < nb_children; ++i) {
+        ev += train(trainplayer, hand, children + i, p, op * strategy[i],
+                    weight, rng);
+      }
+
+      return ev;
+    }
+  }
+}
+
+const uint32_t DiscountedCFR::MAX_EPOCHS;
+
+void DiscountedCFR::init_discounting() {
+  row_epochs.reset(new std::atomic<uint32_t>[regrets.rows()]);
+  for (size_t i = 0; i < regrets.rows(); ++i)
+    row_epochs[i] = 0;
+
+  log_pos = vector<double>(MAX_EPOCHS + 1, 0);
+  log_neg = vector<double>(MAX_EPOCHS + 1, 0);
+  for (uint32_t t = 1; t <= MAX_EPOCHS; ++t) {
+    double ta = std::pow(t, alpha), tb = std::pow(t, beta);
+    log_pos[t] = log_pos[t - 1] + std::log(ta / (ta + 1));
+    log_neg[t] = log_neg[t - 1] + std::log(tb / (tb + 1));
+  }
+}
+
+// past the table log(t^a / (t^a + 1)) ~ -t^-a, summed by its integral.
+double DiscountedCFR::log_pos_factor(uint32_t e) const {
+  if (e <= MAX_EPOCHS)
+    return log_pos[e];
+  double m = MAX_EPOCHS, t = e;
+  double tail = alpha == 1 ? std::log(t / m)
+                           : (std::pow(m, 1 - alpha) - std::pow(t, 1 - alpha)) /
+                                 (alpha - 1);
+  return log_pos[MAX_EPOCHS] - tail;
+}
+
+// with beta = 0 negative regrets are halved every epoch.
+double DiscountedCFR::log_neg_factor(uint32_t e) const {
+  if (beta == 0)
+    return -(double)e * std::log(2.0);
+  return log_neg[std::min(e, MAX_EPOCHS)];
+}
+
+void DiscountedCFR::discount(uint64_t info_idx, unsigned bucket,
+                             uint32_t epoch) {
+  std::atomic<uint32_t> &row_epoch =
+      row_epochs[regrets.row_index(info_idx, bucket)];
+  uint32_t last = row_epoch.load(std::memory_order_relaxed);
+  // only the thread that advances the epoch of the row discounts it.
+  if (last >= epoch || !row_epoch.compare_exchange_strong(last, epoch))
+    return;
+
+  double pos = std::exp(log_pos_factor(epoch) - log_pos_factor(last));
+  double neg = std::exp(log_neg_factor(epoch) - log_neg_factor(last));
+  double avg = std::exp(log_avg_factor(epoch) - log_avg_factor(last));
+
+  entry_t reg = regrets[info_idx];
+  entry_value_t *r = reg.row(bucket);
+  entry_value_t *a = avg_strategy[info_idx].row(bucket);
+  double reg_delta[MAX_ABSTRACT_ACTIONS], avg_delta[MAX_ABSTRACT_ACTIONS];
+  for (unsigned i = 0; i < reg.nb_entries; ++i) {
+    reg_delta[i] = r[i] * ((r[i] > 0 ? pos : neg) - 1);
+    avg_delta[i] = a[i] * (avg - 1);
+  }
+  update_row(r, reg_delta, reg.nb_entries);
+  update_row(a, avg_delta, reg.nb_entries);
+}
+
+void DiscountedCFR::iterate(const hand_t &hand, nbgen &rng) {
+  size_t t = nb_iterations++;
+  size_t max_epoch = beta == 0 ? UINT32_MAX : MAX_EPOCHS;
+  uint32_t epoch = std::min<size_t>(t / interval, max_epoch);
+  train(0, hand, tree.root(), 1, 1, epoch, rng);
+  train(1, hand, tree.root(), 1, 1, epoch, rng);
+}
+
+double DiscountedCFR::train(int trainplayer, const hand_t &hand,
+                            const FlatNode *node, double p, double op,
+                            uint32_t epoch, nbgen &rng) {
+  if (node->is_terminal()) {
+    if (node->is_fold()) {
+      if (trainplayer == node->player)
+        return -node->value;
+      return node->value;
+    }
+    // else showdown
+    return hand.value[trainplayer] * node->value;
+  } else {
+    uint64_t info_idx = node->info_idx;
+    int bucket = hand.buckets[node->player][node->round];
+    const FlatNode *children = tree.children(node);
+
+    discount(info_idx, bucket, epoch);
+
+    double strategy[MAX_ABSTRACT_ACTIONS];
+    unsigned nb_children = get_strategy(info_idx, bucket, strategy);
+
+    if (node->player == trainplayer) {
+      double avg[MAX_ABSTRACT_ACTIONS];
+      for (unsigned i = 0; i < nb_children; ++i)
+        avg[i] = (1.0 / op) * p * strategy[i];
+      update_row(avg_strategy[info_idx].row(bucket), avg, nb_children);
+
+      double utils[MAX_ABSTRACT_ACTIONS];
+      double ev = 0;
+
+      for (unsigned i = 0; i < nb_children; ++i)
+        prefetch_row(children + i, hand);
+
+      for (unsigned i = 0; i < nb_children; ++i) {
+        utils[i] = train(trainplayer, hand, children + i, p * strategy[i], op,
+                         epoch, rng);
+        ev += utils[i] * strategy[i];
+      }
+
+      for (unsigned i = 0; i < nb_children; ++i) {
+        utils[i] -= ev;
+      }
+      update_row(regrets[info_idx].row(bucket), utils, nb_children);
+
+      return ev;
+    } else {
+      int action = sample_strategy(strategy, nb_children, rng);
+      return train(trainplayer, hand, children + action, p,
+                   op * strategy[action], epoch, rng);
+    }
   }
 }
@@ -0,0 +1,685 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "checkpoint.hpp"
+#include "codec.hpp"
+
+using std::string;
+using std::runtime_error;
+
+uint64_t checksum(const void *data, size_t bytes, uint64_t seed) {
+  const uint64_t prime = 1099511628211ULL;
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  uint64_t hash = seed;
+  size_t nb_words = bytes / sizeof(uint64_t);
+  for (size_t i = 0; i < nb_words; ++i) {
+    uint64_t word;
+    memcpy(&word, p + i * sizeof(uint64_t), sizeof(word));
+    hash = (hash ^ word) * prime;
+  }
+  for (size_t i = nb_words * sizeof(uint64_t); i < bytes; ++i)
+    hash = (hash ^ p[i]) * prime;
+  return hash;
+}
+
+uint64_t layout_fingerprint(const entry_c &store) {
+  uint64_t nb_infosets = store.size();
+  uint64_t hash = checksum(&nb_infosets, sizeof(nb_infosets));
+  for (size_t i = 0; i < store.size(); ++i) {
+    uint32_t dims[2] = {store[i].nb_buckets, store[i].nb_entries};
+    hash = checksum(dims, sizeof(dims), hash);
+  }
+  return hash;
+}
+
+static uint64_t align(uint64_t offset) {
+  return (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT *
+         CHECKPOINT_ALIGNMENT;
+}
+
+static void pad_to(std::ofstream &fs, uint64_t offset) {
+  static const char zeros[CHECKPOINT_ALIGNMENT] = {};
+  uint64_t pos = fs.tellp();
+  if (pos < offset)
+    fs.write(zeros, offset - pos);
+}
+
+// reads bytes at offset of fd or throws.
+static void read_at(int fd, void *buf, size_t bytes, uint64_t offset,
+                    const string &filename) {
+  char *p = static_cast<char *>(buf);
+  while (bytes > 0) {
+    ssize_t n = pread(fd, p, bytes, offset);
+    if (n <= 0)
+      throw runtime_error("could not read checkpoint " + filename);
+    p += n;
+    bytes -= n;
+    offset += n;
+  }
+}
+
+// file descriptor that is closed when it goes out of scope.
+struct checkpoint_fd {
+  int fd;
+  checkpoint_fd(const string &filename) {
+    fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw runtime_error("could not open checkpoint " + filename);
+  }
+  ~checkpoint_fd() { close(fd); }
+};
+
+static checkpoint_header_t read_header(int fd, const string &filename) {
+  checkpoint_header_t header;
+  read_at(fd, &header, sizeof(header), 0, filename);
+  if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0)
+    throw runtime_error(filename + " is not a checkpoint");
+  if (header.version != CHECKPOINT_VERSION)
+    throw runtime_error(filename + " has unsupported checkpoint version " +
+                        std::to_string(header.version));
+  if (header.value_size != sizeof(float) &&
+      header.value_size != sizeof(double))
+    throw runtime_error(filename + " has unsupported value size " +
+                        std::to_string(header.value_size));
+  return header;
+}
+
+static std::vector<checkpoint_index_t>
+read_index(int fd, const checkpoint_header_t &header, const string &filename) {
+  std::vector<checkpoint_index_t> index(header.nb_infosets);
+  size_t bytes = index.size() * sizeof(checkpoint_index_t);
+  read_at(fd, index.data(), bytes, header.index_offset, filename);
+  if (checksum(index.data(), bytes) != header.index_checksum)
+    throw runtime_error("corrupt index in checkpoint " + filename);
+  return index;
+}
+
+static compressed_header_t read_compressed_header(int fd,
+                                                  const string &filename) {
+  compressed_header_t header;
+  read_at(fd, &header, sizeof(header), 0, filename);
+  if (memcmp(header.magic, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC)) != 0)
+    throw runtime_error(filename + " is not a compressed checkpoint");
+  if (header.version != COMPRESSED_VERSION)
+    throw runtime_error(filename + " has unsupported compressed version " +
+                        std::to_string(header.version));
+  if ((header.value_size != sizeof(float) &&
+       header.value_size != sizeof(double)) ||
+      header.chunk_values == 0)
+    throw runtime_error(filename + " has an invalid header");
+  return header;
+}
+
+static bool has_magic(const string &filename, const char *magic) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  char buf[sizeof(CHECKPOINT_MAGIC)];
+  if (!file.read(buf, sizeof(buf)))
+    return false;
+  return memcmp(buf, magic, sizeof(buf)) == 0;
+}
+
+bool is_checkpoint(const string &filename) {
+  return has_magic(filename, CHECKPOINT_MAGIC) ||
+         has_magic(filename, COMPRESSED_MAGIC);
+}
+
+bool is_compressed_checkpoint(const string &filename) {
+  return has_magic(filename, COMPRESSED_MAGIC);
+}
+
+checkpoint_header_t read_checkpoint_header(const string &filename) {
+  checkpoint_fd file(filename);
+  return read_header(file.fd, filename);
+}
+
+compressed_header_t read_compressed_header(const string &filename) {
+  checkpoint_fd file(filename);
+  return read_compressed_header(file.fd, filename);
+}
+
+uint64_t checkpoint_fingerprint(const string &filename) {
+  if (is_compressed_checkpoint(filename))
+    return read_compressed_header(filename).fingerprint;
+  return read_checkpoint_header(filename).fingerprint;
+}
+
+void write_checkpoint(const string &filename, const entry_c &regrets,
+                      const entry_c &avg_strategy) {
+  if (regrets.size() != avg_strategy.size() ||
+      regrets.values() != avg_strategy.values())
+    throw runtime_error("regrets and average strategy differ in layout");
+
+  std::vector<checkpoint_index_t> index(regrets.size());
+  for (size_t i = 0; i < index.size(); ++i) {
+    const entry_c::layout_t &l = regrets.get_layout()[i];
+    index[i] = {l.offset, l.nb_buckets, l.nb_entries, l.stride, 0};
+  }
+  size_t index_bytes = index.size() * sizeof(checkpoint_index_t);
+  size_t data_bytes = regrets.values() * sizeof(entry_value_t);
+
+  checkpoint_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  header.version = CHECKPOINT_VERSION;
+  header.value_size = sizeof(entry_value_t);
+  header.fingerprint = layout_fingerprint(regrets);
+  header.nb_infosets = index.size();
+  header.index_offset = CHECKPOINT_ALIGNMENT;
+  header.regrets_offset = align(header.index_offset + index_bytes);
+  header.avg_offset = align(header.regrets_offset + data_bytes);
+  header.nb_values = regrets.values();
+  header.index_checksum = checksum(index.data(), index_bytes);
+  header.data_checksum =
+      checksum(avg_strategy.data(), data_bytes,
+               checksum(regrets.data(), data_bytes));
+
+  string tmpfile = filename + ".tmp";
+  std::ofstream fs(tmpfile.c_str(), std::ios::out | std::ios::binary);
+  fs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  pad_to(fs, header.index_offset);
+  fs.write(reinterpret_cast<const char *>(index.data()), index_bytes);
+  pad_to(fs, header.regrets_offset);
+  fs.write(reinterpret_cast<const char *>(regrets.data()), data_bytes);
+  pad_to(fs, header.avg_offset);
+  fs.write(reinterpret_cast<const char *>(avg_strategy.data()), data_bytes);
+  fs.close();
+  if (!fs)
+    throw runtime_error("could not write checkpoint " + tmpfile);
+  if (rename(tmpfile.c_str(), filename.c_str()) != 0)
+    throw runtime_error("could not rename " + tmpfile + " to " + filename);
+}
+
+// calls work(i) for every i < n on nb_threads threads.
+static void parallel_for(size_t n, unsigned nb_threads,
+                         const std::function<void(size_t)> &work) {
+  if (nb_threads == 0)
+    nb_threads = std::max(1u, std::thread::hardware_concurrency());
+  nb_threads = std::min<size_t>(nb_threads, std::max<size_t>(n, 1));
+  std::atomic<size_t> next(0);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < nb_threads; ++t)
+    threads.emplace_back([&] {
+      try {
+        for (size_t i = next++; i < n; i = next++)
+          work(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        error = std::current_exception();
+        next = n;
+      }
+    });
+  for (std::thread &t : threads)
+    t.join();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+// values of chunk c of a compressed checkpoint: store, first value and
+// number of values.
+static void chunk_range(const compressed_header_t &header, uint64_t c,
+                        int &store, uint64_t &first, uint64_t &n) {
+  store = c / header.nb_chunks;
+  first = (c % header.nb_chunks) * header.chunk_values;
+  n = std::min(header.chunk_values, header.nb_values - first);
+}
+
+// copies n values of type From to type To.
+template <class From, class To>
+static void convert_values(const void *from, void *to, size_t n) {
+  const From *f = static_cast<const From *>(from);
+  To *t = static_cast<To *>(to);
+  for (size_t i = 0; i < n; ++i)
+    t[i] = f[i];
+}
+
+void write_compressed_checkpoint(const string &filename,
+                                 const entry_c &regrets,
+                                 const entry_c &avg_strategy, bool as_float,
+                                 unsigned nb_threads) {
+  if (regrets.size() != avg_strategy.size() ||
+      regrets.values() != avg_strategy.values())
+    throw runtime_error("regrets and average strategy differ in layout");
+
+  std::vector<checkpoint_index_t> index(regrets.size());
+  for (size_t i = 0; i < index.size(); ++i) {
+    const entry_c::layout_t &l = regrets.get_layout()[i];
+    index[i] = {l.offset, l.nb_buckets, l.nb_entries, l.stride, 0};
+  }
+  size_t index_bytes = index.size() * sizeof(checkpoint_index_t);
+
+  compressed_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC));
+  header.version = COMPRESSED_VERSION;
+  header.value_size = as_float ? sizeof(float) : sizeof(entry_value_t);
+  header.fingerprint = layout_fingerprint(regrets);
+  header.nb_infosets = index.size();
+  header.nb_values = regrets.values();
+  header.chunk_values = COMPRESSED_CHUNK_VALUES;
+  header.nb_chunks =
+      (header.nb_values + header.chunk_values - 1) / header.chunk_values;
+  header.index_offset = sizeof(header);
+  header.chunks_offset = header.index_offset + index_bytes;
+  header.index_checksum = checksum(index.data(), index_bytes);
+
+  size_t nb_chunks = 2 * header.nb_chunks;
+  std::vector<compressed_chunk_t> chunks(nb_chunks);
+  uint64_t offset =
+      header.chunks_offset + nb_chunks * sizeof(compressed_chunk_t);
+
+  string tmpfile = filename + ".tmp";
+  std::ofstream fs(tmpfile.c_str(), std::ios::out | std::ios::binary);
+  fs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  fs.write(reinterpret_cast<const char *>(index.data()), index_bytes);
+  fs.write(reinterpret_cast<const char *>(chunks.data()),
+           nb_chunks * sizeof(compressed_chunk_t));
+
+  // chunks are encoded in batches, so only a batch is held in memory.
+  const entry_c *stores[2] = {&regrets, &avg_strategy};
+  size_t batch_size =
+      4 * std::max(1u, nb_threads ? nb_threads
+                                  : std::thread::hardware_concurrency());
+  std::vector<std::vector<uint8_t>> encoded(batch_size);
+  for (size_t batch = 0; batch < nb_chunks; batch += batch_size) {
+    size_t n = std::min(batch_size, nb_chunks - batch);
+    parallel_for(n, nb_threads, [&](size_t i) {
+      int s;
+      uint64_t first, nb_values;
+      chunk_range(header, batch + i, s, first, nb_values);
+      size_t bytes = nb_values * header.value_size;
+      std::vector<uint8_t> raw(bytes), shuffled(bytes);
+      const entry_value_t *values = stores[s]->data() + first;
+      if (header.value_size == sizeof(entry_value_t))
+        memcpy(raw.data(), values, bytes);
+      else
+        convert_values<entry_value_t, float>(values, raw.data(), nb_values);
+      chunks[batch + i].checksum = checksum(raw.data(), bytes);
+      shuffle_bytes(raw.data(), shuffled.data(), nb_values,
+                    header.value_size);
+      encoded[i].clear();
+      lz_compress(shuffled.data(), bytes, encoded[i]);
+      // chunks that do not compress are stored shuffled only.
+      if (encoded[i].size() >= bytes)
+        encoded[i] = shuffled;
+    });
+    for (size_t i = 0; i < n; ++i) {
+      chunks[batch + i].offset = offset;
+      chunks[batch + i].bytes = encoded[i].size();
+      fs.write(reinterpret_cast<const char *>(encoded[i].data()),
+               encoded[i].size());
+      offset += encoded[i].size();
+    }
+  }
+
+  fs.seekp(header.chunks_offset);
+  fs.write(reinterpret_cast<const char *>(chunks.data()),
+           nb_chunks * sizeof(compressed_chunk_t));
+  fs.close();
+  if (!fs)
+    throw runtime_error("could not write checkpoint " + tmpfile);
+  if (rename(tmpfile.c_str(), filename.c_str()) != 0)
+    throw runtime_error("could not rename " + tmpfile + " to " + filename);
+}
+
+// decodes every chunk of a compressed checkpoint on all cores, checks its
+// checksum and passes its converted values to use.
+static void decode_chunks(
+    int fd, const compressed_header_t &header, const string &filename,
+    const std::function<void(uint64_t, const uint8_t *)> &use) {
+  size_t nb_chunks = 2 * header.nb_chunks;
+  std::vector<compressed_chunk_t> chunks(nb_chunks);
+  read_at(fd, chunks.data(), nb_chunks * sizeof(compressed_chunk_t),
+          header.chunks_offset, filename);
+
+  parallel_for(nb_chunks, 0, [&](size_t c) {
+    int s;
+    uint64_t first, nb_values;
+    chunk_range(header, c, s, first, nb_values);
+    size_t bytes = nb_values * header.value_size;
+    std::vector<uint8_t> encoded(chunks[c].bytes), shuffled(bytes), raw(bytes);
+    read_at(fd, encoded.data(), encoded.size(), chunks[c].offset, filename);
+    if (encoded.size() == bytes)
+      shuffled.swap(encoded);
+    else
+      lz_decompress(encoded.data(), encoded.size(), shuffled.data(), bytes);
+    unshuffle_bytes(shuffled.data(), raw.data(), nb_values, header.value_size);
+    if (checksum(raw.data(), bytes) != chunks[c].checksum)
+      throw runtime_error("corrupt chunk " + std::to_string(c) + " in " +
+                          filename);
+    use(c, raw.data());
+  });
+}
+
+static std::vector<checkpoint_index_t>
+read_index(int fd, const compressed_header_t &header, const string &filename) {
+  std::vector<checkpoint_index_t> index(header.nb_infosets);
+  size_t bytes = index.size() * sizeof(checkpoint_index_t);
+  read_at(fd, index.data(), bytes, header.index_offset, filename);
+  if (checksum(index.data(), bytes) != header.index_checksum)
+    throw runtime_error("corrupt index in checkpoint " + filename);
+  return index;
+}
+
+static void read_compressed(int fd, const compressed_header_t &header,
+                            const string &filename, entry_c &regrets,
+                            entry_c &avg_strategy) {
+  std::vector<checkpoint_index_t> index = read_index(fd, header, filename);
+
+  std::vector<entry_c::layout_t> layout(index.size());
+  for (size_t i = 0; i < index.size(); ++i)
+    layout[i] = {index[i].offset, 0, index[i].nb_buckets, index[i].nb_entries,
+                 index[i].stride};
+  regrets.allocate(layout, header.nb_values);
+  avg_strategy.allocate(layout, header.nb_values);
+
+  entry_c *stores[2] = {&regrets, &avg_strategy};
+  decode_chunks(fd, header, filename, [&](uint64_t c, const uint8_t *raw) {
+    int s;
+    uint64_t first, nb_values;
+    chunk_range(header, c, s, first, nb_values);
+    entry_value_t *values = stores[s]->data() + first;
+    if (header.value_size == sizeof(entry_value_t))
+      memcpy(values, raw, nb_values * sizeof(entry_value_t));
+    else if (header.value_size == sizeof(float))
+      convert_values<float, entry_value_t>(raw, values, nb_values);
+    else
+      convert_values<double, entry_value_t>(raw, values, nb_values);
+  });
+}
+
+// maps both data sections as stores of type T.
+template <class T>
+static void map_sections(int fd, const checkpoint_header_t &header,
+                         const std::vector<checkpoint_index_t> &index,
+                         EntryStore<T> &regrets, EntryStore<T> &avg_strategy) {
+  std::vector<typename EntryStore<T>::layout_t> layout(index.size());
+  for (size_t i = 0; i < index.size(); ++i)
+    layout[i] = {index[i].offset, 0, index[i].nb_buckets, index[i].nb_entries,
+                 index[i].stride};
+  regrets.map_file(layout, header.nb_values, fd, header.regrets_offset);
+  avg_strategy.map_file(layout, header.nb_values, fd, header.avg_offset);
+}
+
+// copies the values of from into the freshly allocated store to.
+template <class T> static void convert(const EntryStore<T> &from, entry_c &to) {
+  to = entry_c(from.size());
+  for (size_t i = 0; i < from.size(); ++i)
+    to.init(i, from[i].nb_buckets, from[i].nb_entries);
+  to.allocate();
+  for (size_t i = 0; i < from.size(); ++i) {
+    Entry<T> src = from[i];
+    entry_t dst = to[i];
+    for (unsigned b = 0; b < src.nb_buckets; ++b)
+      std::copy(src.row(b), src.row(b) + src.nb_entries, dst.row(b));
+  }
+}
+
+void read_checkpoint(const string &filename, entry_c &regrets,
+                     entry_c &avg_strategy, uint64_t fingerprint) {
+  checkpoint_fd file(filename);
+  if (is_compressed_checkpoint(filename)) {
+    compressed_header_t header = read_compressed_header(file.fd, filename);
+    if (header.fingerprint != fingerprint)
+      throw runtime_error(filename + " was written for another game or "
+                                     "abstraction");
+    read_compressed(file.fd, header, filename, regrets, avg_strategy);
+    return;
+  }
+
+  checkpoint_header_t header = read_header(file.fd, filename);
+  if (header.fingerprint != fingerprint)
+    throw runtime_error(filename + " was written for another game or "
+                                   "abstraction");
+  std::vector<checkpoint_index_t> index = read_index(file.fd, header, filename);
+
+  // mapped pages past the end of the file would fault on first touch.
+  uint64_t section = header.nb_values * header.value_size;
+  uint64_t end = std::max(header.regrets_offset, header.avg_offset) + section;
+  struct stat st;
+  if (fstat(file.fd, &st) != 0 || (uint64_t)st.st_size < end)
+    throw runtime_error("truncated checkpoint " + filename);
+
+  if (header.value_size == sizeof(entry_value_t)) {
+    map_sections(file.fd, header, index, regrets, avg_strategy);
+  } else if (header.value_size == sizeof(float)) {
+    EntryStore<float> reg, avg;
+    map_sections(file.fd, header, index, reg, avg);
+    convert(reg, regrets);
+    convert(avg, avg_strategy);
+  } else {
+    EntryStore<double> reg, avg;
+    map_sections(file.fd, header, index, reg, avg);
+    convert(reg, regrets);
+    convert(avg, avg_strategy);
+  }
+}
+
+bool verify_checkpoint(const string &filename) {
+  checkpoint_fd file(filename);
+  if (is_compressed_checkpoint(filename)) {
+    compressed_header_t header = read_compressed_header(file.fd, filename);
+    try {
+      read_index(file.fd, header, filename);
+      decode_chunks(file.fd, header, filename, [](uint64_t, const uint8_t *) {});
+    } catch (std::runtime_error &) {
+      return false;
+    }
+    return true;
+  }
+
+  checkpoint_header_t header = read_header(file.fd, filename);
+  std::vector<checkpoint_index_t> index = read_index(file.fd, header, filename);
+
+  std::vector<char> buf(1 << 20);
+  uint64_t hash = 14695981039346656037ULL;
+  uint64_t offsets[2] = {header.regrets_offset, header.avg_offset};
+  uint64_t bytes = header.nb_values * header.value_size;
+  for (uint64_t offset : offsets) {
+    // chunks are multiples of 8 bytes, so hashing them one after another
+    // equals hashing the section at once.
+    for (uint64_t done = 0; done < bytes; done += buf.size()) {
+      size_t n = std::min<uint64_t>(buf.size(), bytes - done);
+      read_at(file.fd, buf.data(), n, offset + done, filename);
+      hash = checksum(buf.data(), n, hash);
+    }
+  }
+  return hash == header.data_checksum;
+}
+
+// first value and number of values of region r of a store.
+static void region_range(uint64_t r, uint64_t region_values, uint64_t nb_values,
+                         uint64_t &first, uint64_t &n) {
+  first = r * region_values;
+  if (first >= nb_values)
+    throw runtime_error("region out of range");
+  n = std::min(region_values, nb_values - first);
+}
+
+void write_delta(const string &filename, const entry_c &regrets,
+                 const entry_c &avg_strategy,
+                 const std::vector<uint64_t> &regret_regions,
+                 const std::vector<uint64_t> &avg_regions) {
+  if (regrets.values() != avg_strategy.values())
+    throw runtime_error("regrets and average strategy differ in layout");
+
+  delta_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, DELTA_MAGIC, sizeof(DELTA_MAGIC));
+  header.version = DELTA_VERSION;
+  header.value_size = sizeof(entry_value_t);
+  header.fingerprint = layout_fingerprint(regrets);
+  header.nb_values = regrets.values();
+  header.region_values = entry_c::REGION_VALUES;
+  header.nb_regret_regions = regret_regions.size();
+  header.nb_avg_regions = avg_regions.size();
+
+  const entry_c *stores[2] = {&regrets, &avg_strategy};
+  const std::vector<uint64_t> *regions[2] = {&regret_regions, &avg_regions};
+  uint64_t hash = checksum(regret_regions.data(),
+                           regret_regions.size() * sizeof(uint64_t));
+  hash = checksum(avg_regions.data(), avg_regions.size() * sizeof(uint64_t),
+                  hash);
+  for (int s = 0; s < 2; ++s) {
+    for (uint64_t r : *regions[s]) {
+      uint64_t first, n;
+      region_range(r, header.region_values, header.nb_values, first, n);
+      hash = checksum(stores[s]->data() + first, n * sizeof(entry_value_t),
+                      hash);
+    }
+  }
+  header.checksum = hash;
+
+  string tmpfile = filename + ".tmp";
+  std::ofstream fs(tmpfile.c_str(), std::ios::out | std::ios::binary);
+  fs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (int s = 0; s < 2; ++s)
+    fs.write(reinterpret_cast<const char *>(regions[s]->data()),
+             regions[s]->size() * sizeof(uint64_t));
+  for (int s = 0; s < 2; ++s) {
+    for (uint64_t r : *regions[s]) {
+      uint64_t first, n;
+      region_range(r, header.region_values, header.nb_values, first, n);
+      fs.write(reinterpret_cast<const char *>(stores[s]->data() + first),
+               n * sizeof(entry_value_t));
+    }
+  }
+  fs.close();
+  if (!fs)
+    throw runtime_error("could not write delta checkpoint " + tmpfile);
+  if (rename(tmpfile.c_str(), filename.c_str()) != 0)
+    throw runtime_error("could not rename " + tmpfile + " to " + filename);
+}
+
+void apply_delta(const string &filename, entry_c &regrets,
+                 entry_c &avg_strategy) {
+  checkpoint_fd file(filename);
+  delta_header_t header;
+  read_at(file.fd, &header, sizeof(header), 0, filename);
+  if (memcmp(header.magic, DELTA_MAGIC, sizeof(DELTA_MAGIC)) != 0)
+    throw runtime_error(filename + " is not a delta checkpoint");
+  if (header.version != DELTA_VERSION)
+    throw runtime_error(filename + " has unsupported delta version " +
+                        std::to_string(header.version));
+  if (header.value_size != sizeof(entry_value_t))
+    throw runtime_error(filename + " was written with another value type");
+  if (header.fingerprint != layout_fingerprint(regrets) ||
+      header.nb_values != regrets.values() ||
+      header.nb_values != avg_strategy.values() || header.region_values == 0)
+    throw runtime_error(filename + " was written for another layout");
+
+  std::vector<uint64_t> regions[2];
+  regions[0].resize(header.nb_regret_regions);
+  regions[1].resize(header.nb_avg_regions);
+  uint64_t offset = sizeof(header);
+  uint64_t hash = 14695981039346656037ULL;
+  for (int s = 0; s < 2; ++s) {
+    size_t bytes = regions[s].size() * sizeof(uint64_t);
+    read_at(file.fd, regions[s].data(), bytes, offset, filename);
+    hash = checksum(regions[s].data(), bytes, hash);
+    offset += bytes;
+  }
+
+  entry_c *stores[2] = {&regrets, &avg_strategy};
+  for (int s = 0; s < 2; ++s) {
+    for (uint64_t r : regions[s]) {
+      uint64_t first, n;
+      region_range(r, header.region_values, header.nb_values, first, n);
+      size_t bytes = n * sizeof(entry_value_t);
+      read_at(file.fd, stores[s]->data() + first, bytes, offset, filename);
+      hash = checksum(stores[s]->data() + first, bytes, hash);
+      offset += bytes;
+    }
+  }
+  if (hash != header.checksum)
+    throw runtime_error("corrupt delta checkpoint " + filename);
+}
+
+// directory part of path including the trailing slash.
+static string directory_of(const string &path) {
+  size_t slash = path.rfind('/');
+  return slash == string::npos ? "" : path.substr(0, slash + 1);
+}
+
+void write_manifest(const string &manifest,
+                    const std::vector<string> &files) {
+  string tmpfile = manifest + ".tmp";
+  std::ofstream fs(tmpfile.c_str());
+  for (size_t i = 0; i < files.size(); ++i)
+    fs << (i == 0 ? "base " : "delta ")
+       << files[i].substr(directory_of(files[i]).size()) << "\n";
+  fs.close();
+  if (!fs)
+    throw runtime_error("could not write manifest " + tmpfile);
+  if (rename(tmpfile.c_str(), manifest.c_str()) != 0)
+    throw runtime_error("could not rename " + tmpfile + " to " + manifest);
+}
+
+std::vector<string> read_manifest(const string &manifest) {
+  std::ifstream fs(manifest.c_str());
+  if (!fs)
+    throw runtime_error("could not open manifest " + manifest);
+  std::vector<string> files;
+  string kind, file;
+  while (fs >> kind >> file) {
+    if (kind != (files.empty() ? "base" : "delta"))
+      throw runtime_error("unexpected " + kind + " in manifest " + manifest);
+    files.push_back(directory_of(manifest) + file);
+  }
+  if (files.empty())
+    throw runtime_error("empty manifest " + manifest);
+  return files;
+}
+
+// entries are stored as doubles, independent of entry_value_t.
+static void read_legacy_entries(std::ifstream &file, entry_c &store) {
+  std::streampos start = file.tellg();
+  unsigned nb_buckets, nb_entries;
+  for (size_t i = 0; i < store.size(); ++i) {
+    file.read(reinterpret_cast<char *>(&nb_buckets), sizeof(nb_buckets));
+    file.read(reinterpret_cast<char *>(&nb_entries), sizeof(nb_entries));
+    store.init(i, nb_buckets, nb_entries);
+    file.seekg(sizeof(double) * nb_buckets * nb_entries, std::ios::cur);
+  }
+  store.allocate();
+
+  file.seekg(start);
+  std::vector<double> row;
+  for (size_t i = 0; i < store.size(); ++i) {
+    file.read(reinterpret_cast<char *>(&nb_buckets), sizeof(nb_buckets));
+    file.read(reinterpret_cast<char *>(&nb_entries), sizeof(nb_entries));
+    entry_t entry = store[i];
+    row.resize(nb_entries);
+    for (unsigned b = 0; b < nb_buckets; ++b) {
+      file.read(reinterpret_cast<char *>(row.data()),
+                sizeof(double) * nb_entries);
+      std::copy(row.begin(), row.end(), entry.row(b));
+    }
+  }
+}
+
+void read_legacy_dump(const string &filename, entry_c &regrets,
+                      entry_c &avg_strategy) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  size_t nb_infosets;
+  if (!file.read(reinterpret_cast<char *>(&nb_infosets), sizeof(nb_infosets)))
+    throw runtime_error("could not read strategy " + filename);
+
+  regrets = entry_c(nb_infosets);
+  read_legacy_entries(file, regrets);
+  avg_strategy = entry_c(nb_infosets);
+  read_legacy_entries(file, avg_strategy);
+  if (!file)
+    throw runtime_error("truncated strategy " + filename);
+}
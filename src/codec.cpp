@@ -0,0 +1,140 @@
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include "codec.hpp"
+
+const int LZ_HASH_BITS = 16;
+const size_t LZ_MIN_MATCH = 4;
+const size_t LZ_MAX_OFFSET = 65535;
+
+void shuffle_bytes(const uint8_t *in, uint8_t *out, size_t nb_values,
+                   size_t value_size) {
+  for (size_t i = 0; i < nb_values; ++i)
+    for (size_t b = 0; b < value_size; ++b)
+      out[b * nb_values + i] = in[i * value_size + b];
+}
+
+void unshuffle_bytes(const uint8_t *in, uint8_t *out, size_t nb_values,
+                     size_t value_size) {
+  for (size_t b = 0; b < value_size; ++b)
+    for (size_t i = 0; i < nb_values; ++i)
+      out[i * value_size + b] = in[b * nb_values + i];
+}
+
+static uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t hash4(uint32_t v) {
+  return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+// writes the part of a length that does not fit into its nibble.
+static void put_length(std::vector<uint8_t> &out, size_t len) {
+  for (; len >= 255; len -= 255)
+    out.push_back(255);
+  out.push_back(len);
+}
+
+// a sequence without match_len ends the block.
+static void put_sequence(std::vector<uint8_t> &out, const uint8_t *literals,
+                         size_t nb_literals, size_t offset, size_t match_len) {
+  size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+  out.push_back(std::min<size_t>(nb_literals, 15) << 4 |
+                std::min<size_t>(ml, 15));
+  if (nb_literals >= 15)
+    put_length(out, nb_literals - 15);
+  out.insert(out.end(), literals, literals + nb_literals);
+  if (!match_len)
+    return;
+  out.push_back(offset & 0xff);
+  out.push_back(offset >> 8);
+  if (ml >= 15)
+    put_length(out, ml - 15);
+}
+
+void lz_compress(const uint8_t *in, size_t n, std::vector<uint8_t> &out) {
+  // position + 1 of the last occurrence of a hashed 4 byte sequence.
+  std::vector<uint32_t> table(1 << LZ_HASH_BITS, 0);
+  size_t ip = 0, anchor = 0, misses = 0;
+  while (ip + LZ_MIN_MATCH <= n) {
+    uint32_t seq = read32(in + ip);
+    uint32_t &slot = table[hash4(seq)];
+    size_t candidate = slot;
+    slot = ip + 1;
+    if (candidate == 0 || ip - (candidate - 1) > LZ_MAX_OFFSET ||
+        read32(in + candidate - 1) != seq) {
+      // step faster through data that does not compress.
+      ip += 1 + (misses++ >> 6);
+      continue;
+    }
+
+    size_t match = candidate - 1, len = LZ_MIN_MATCH;
+    while (ip + len < n && in[match + len] == in[ip + len])
+      ++len;
+    put_sequence(out, in + anchor, ip - anchor, ip - match, len);
+    ip += len;
+    anchor = ip;
+    misses = 0;
+  }
+  put_sequence(out, in + anchor, n - anchor, 0, 0);
+}
+
+static size_t get_length(const uint8_t *&ip, const uint8_t *end) {
+  size_t len = 0;
+  uint8_t b;
+  do {
+    if (ip == end)
+      throw std::runtime_error("truncated lz block");
+    b = *ip++;
+    len += b;
+  } while (b == 255);
+  return len;
+}
+
+void lz_decompress(const uint8_t *in, size_t n, uint8_t *out,
+                   size_t raw_bytes) {
+  const uint8_t *ip = in, *end = in + n;
+  uint8_t *op = out, *oend = out + raw_bytes;
+  while (true) {
+    if (ip == end)
+      throw std::runtime_error("truncated lz block");
+    uint8_t token = *ip++;
+    size_t nb_literals = token >> 4;
+    if (nb_literals == 15)
+      nb_literals += get_length(ip, end);
+    if (nb_literals > (size_t)(end - ip) || nb_literals > (size_t)(oend - op))
+      throw std::runtime_error("corrupt lz block");
+    memcpy(op, ip, nb_literals);
+    ip += nb_literals;
+    op += nb_literals;
+    if (ip == end)
+      break;
+
+    if (end - ip < 2)
+      throw std::runtime_error("truncated lz block");
+    size_t offset = ip[0] | ip[1] << 8;
+    ip += 2;
+    size_t len = token & 15;
+    if (len == 15)
+      len += get_length(ip, end);
+    len += LZ_MIN_MATCH;
+    if (offset == 0 || offset > (size_t)(op - out) ||
+        len > (size_t)(oend - op))
+      throw std::runtime_error("corrupt lz block");
+
+    // a match may overlap its own output. the copied part repeats with the
+    // period of the offset, so it can be copied in doubling pieces.
+    const uint8_t *match = op - offset;
+    while (len > 0) {
+      size_t piece = std::min<size_t>(len, op - match);
+      memcpy(op, match, piece);
+      op += piece;
+      len -= piece;
+    }
+  }
+  if (op != oend)
+    throw std::runtime_error("lz block is shorter than expected");
+}
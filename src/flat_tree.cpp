@@ -0,0 +1,252 @@
+#include "flat_tree.hpp"
+#include "action_translation.hpp"
+
+const uint32_t FlatTree::NO_NODE;
+const uint64_t FlatTree::SEQUENCE_SEED;
+
+FlatTree::FlatTree(INode *root)
+    : node_store(1), action_store(1), sequence_table(NULL), nb_slots(0),
+      source(1) {
+  fill(0, root);
+  nb_nodes = node_store.size();
+  nodes = node_store.data();
+  actions = action_store.data();
+}
+
+FlatTree::FlatTree(const FlatNode *nodes, const Action *actions,
+                   size_t nb_nodes, const sequence_slot_t *sequence_table,
+                   size_t nb_slots)
+    : nb_nodes(nb_nodes), sequence_table(sequence_table), nb_slots(nb_slots),
+      nodes(nodes), actions(actions) {}
+
+void FlatTree::fill(uint32_t slot, INode *node) {
+  FlatNode &n = node_store[slot];
+  source[slot] = node;
+  action_store[slot] = node->get_action();
+  n.first_child = 0;
+  n.nb_children = 0;
+  n.round = 0;
+
+  if (node->is_terminal()) {
+    if (node->is_fold()) {
+      n.type = FLAT_FOLD;
+      n.player = node->get_player();
+      n.value = ((FoldNode *)node)->value;
+    } else {
+      n.type = FLAT_SHOWDOWN;
+      n.player = 0;
+      n.value = ((ShowdownNode *)node)->value;
+    }
+    return;
+  }
+
+  InformationSetNode *infoset = (InformationSetNode *)node;
+  const vector<INode *> &children = infoset->get_children();
+  uint32_t first = node_store.size();
+  n.type = FLAT_INFOSET;
+  n.player = infoset->get_player();
+  n.round = infoset->get_round();
+  n.nb_children = children.size();
+  n.first_child = first;
+  n.info_idx = infoset->get_idx();
+
+  // n is invalidated by the resize.
+  node_store.resize(first + children.size());
+  action_store.resize(first + children.size());
+  source.resize(first + children.size());
+  for (unsigned i = 0; i < children.size(); ++i)
+    fill(first + i, children[i]);
+}
+
+uint32_t FlatTree::lookup_state(const State *state,
+                                std::vector<double> &sizes, nbgen &rng,
+                                uint32_t curr_node, int current_round,
+                                int curr_action) const {
+  const FlatNode &node = nodes[curr_node];
+
+  // we could have been pushed off tree.
+  if (node.is_terminal())
+    return NO_NODE;
+
+  int round = node.round;
+  if (current_round < round)
+    curr_action = 0;
+
+  if (curr_action >= state->numActions[round]) {
+    assert(round == state->round);
+    return curr_node;
+  }
+
+  Action action = state->action[round][curr_action];
+  uint32_t child = NO_NODE;
+  int first_raise_idx = -1;
+
+  for (unsigned i = 0; i < node.nb_children; ++i) {
+    const Action &caction = actions[node.first_child + i];
+    if (caction.type == action.type && caction.type != a_raise)
+      child = node.first_child + i;
+    else if (caction.type == a_raise && first_raise_idx < 0)
+      first_raise_idx = i;
+  }
+
+  if (child != NO_NODE)
+    return lookup_state(state, sizes, rng, child, round, curr_action + 1);
+  if (action.type != a_raise || first_raise_idx < 0)
+    return NO_NODE;
+
+  // raise actions. sizes is refilled by the lookups below, the bounds are
+  // taken before.
+  sizes.clear();
+  for (unsigned i = first_raise_idx; i < node.nb_children; ++i)
+    sizes.push_back(actions[node.first_child + i].size);
+
+  PseudoHarmonicMapping mapper;
+  unsigned lower_bound, upper_bound;
+  int bound_res =
+      mapper.get_bounds(sizes, action.size, lower_bound, upper_bound);
+  unsigned abstract_size =
+      mapper.map_dart(sizes, action.size, rng() / (rng.max() + 1.0));
+  unsigned unused_bound =
+      abstract_size == lower_bound ? upper_bound : lower_bound;
+
+  // check if tree can be traversed in that node. if not, take the unused
+  // bound even when its worse.
+  child = node.first_child + first_raise_idx + abstract_size;
+  uint32_t res =
+      lookup_state(state, sizes, rng, child, round, curr_action + 1);
+  if (res == NO_NODE && bound_res == 0) {
+    child = node.first_child + first_raise_idx + unused_bound;
+    return lookup_state(state, sizes, rng, child, round, curr_action + 1);
+  }
+  return res;
+}
+
+uint64_t FlatTree::sequence_hash(uint64_t hash, const Action &action) {
+  uint64_t v = (uint64_t)action.type << 32 |
+               (uint32_t)(action.type == a_raise ? action.size : 0);
+  // splitmix64 finalizer over the combined value.
+  uint64_t z = hash * 0x9e3779b97f4a7c15ULL + v + 0x632be59bd9b4e019ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return (z ^ (z >> 31)) | 1;
+}
+
+void FlatTree::insert_sequence(uint64_t hash, uint32_t node) {
+  size_t mask = slot_store.size() - 1;
+  size_t slot = hash & mask;
+  while (slot_store[slot].hash != 0)
+    slot = (slot + 1) & mask;
+  slot_store[slot] = {hash, node, 0};
+}
+
+void FlatTree::index_sequences(uint32_t node, uint64_t hash) {
+  const FlatNode &n = nodes[node];
+  if (n.is_terminal())
+    return;
+  insert_sequence(hash, node);
+  for (unsigned i = 0; i < n.nb_children; ++i)
+    index_sequences(n.first_child + i,
+                    sequence_hash(hash, actions[n.first_child + i]));
+}
+
+void FlatTree::build_sequence_index() {
+  size_t nb_infosets = 0;
+  for (size_t i = 0; i < nb_nodes; ++i)
+    nb_infosets += !nodes[i].is_terminal();
+  // at most half full.
+  size_t capacity = 1;
+  while (capacity < 2 * nb_infosets)
+    capacity *= 2;
+  slot_store.assign(capacity, {0, NO_NODE, 0});
+  index_sequences(0, SEQUENCE_SEED);
+  sequence_table = slot_store.data();
+  nb_slots = slot_store.size();
+}
+
+uint32_t FlatTree::find_sequence(const State *state) const {
+  if (nb_slots == 0)
+    return NO_NODE;
+  uint64_t hash = SEQUENCE_SEED;
+  for (int r = 0; r <= state->round; ++r)
+    for (int a = 0; a < state->numActions[r]; ++a)
+      hash = sequence_hash(hash, state->action[r][a]);
+
+  size_t mask = nb_slots - 1;
+  for (size_t slot = hash & mask; sequence_table[slot].hash != 0;
+       slot = (slot + 1) & mask)
+    if (sequence_table[slot].hash == hash)
+      return sequence_table[slot].node;
+  return NO_NODE;
+}
+
+uint32_t FlatTree::step(uint32_t node, const Action &action,
+                        std::vector<double> &sizes, nbgen &rng) const {
+  const FlatNode &n = nodes[node];
+  if (n.is_terminal())
+    return NO_NODE;
+
+  int first_raise = -1;
+  for (unsigned i = 0; i < n.nb_children; ++i) {
+    const Action &caction = actions[n.first_child + i];
+    if (caction.type == action.type && caction.type != a_raise)
+      return n.first_child + i;
+    if (caction.type == a_raise && first_raise < 0)
+      first_raise = i;
+  }
+  if (action.type != a_raise || first_raise < 0)
+    return NO_NODE;
+
+  sizes.clear();
+  for (unsigned i = first_raise; i < n.nb_children; ++i)
+    sizes.push_back(actions[n.first_child + i].size);
+  PseudoHarmonicMapping mapper;
+  return n.first_child + first_raise +
+         mapper.map_dart(sizes, action.size, rng() / (rng.max() + 1.0));
+}
+
+uint32_t FlatTree::advance(tree_cursor_t &cursor, const State *state,
+                           nbgen &rng) const {
+  bool same_hand =
+      cursor.node != NO_NODE && cursor.hand_id == state->handId &&
+      (cursor.round < state->round ||
+       (cursor.round == state->round &&
+        cursor.action <= state->numActions[state->round]));
+  if (!same_hand) {
+    cursor.hand_id = state->handId;
+    cursor.node = find_sequence(state);
+    if (cursor.node != NO_NODE) {
+      cursor.round = state->round;
+      cursor.action = state->numActions[state->round];
+      return cursor.node;
+    }
+    cursor.node = 0;
+    cursor.round = 0;
+    cursor.action = 0;
+  }
+
+  while (true) {
+    if (cursor.action < state->numActions[cursor.round]) {
+      uint32_t child = step(cursor.node,
+                            state->action[cursor.round][cursor.action],
+                            cursor.sizes, rng);
+      if (child == NO_NODE)
+        break;
+      cursor.node = child;
+      ++cursor.action;
+    } else if (cursor.round < state->round) {
+      ++cursor.round;
+      cursor.action = 0;
+    } else if (!nodes[cursor.node].is_terminal()) {
+      return cursor.node;
+    } else {
+      break;
+    }
+  }
+
+  // the mapped actions left the tree. lookup_state retries the other
+  // bound of the raises on the way.
+  cursor.node = lookup_state(state, cursor.sizes, rng);
+  cursor.round = state->round;
+  cursor.action = state->numActions[state->round];
+  return cursor.node;
+}
@@ -0,0 +1,209 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <boost/program_options.hpp>
+#include "cfrm.hpp"
+#include "agent_strategy.hpp"
+#include "lbr.hpp"
+#include "functions.hpp"
+#include "main_functions.hpp"
+
+using namespace std;
+namespace ch = std::chrono;
+namespace po = boost::program_options;
+
+int parse_options(int argc, char **argv);
+void read_game(char *game_definition);
+
+struct {
+  string game_definition = "games/holdem.limit.2p.reverse_blinds.game";
+  string handranks_path = "/usr/local/freedom/data/handranks.dat";
+
+  card_abstraction card_abs = CLUSTERCARD_ABS;
+  action_abstraction action_abs = NULLACTION_ABS;
+  string card_abs_param = "";
+  string action_abs_param = "";
+
+  string init_strategy = "";
+
+  // hands played in total, the seats alternate.
+  uint64_t nb_hands = 1000000;
+  int nb_threads = 1;
+  unsigned seed = 0;
+  string bets = "1";
+  unsigned rollouts = 24;
+} options;
+
+// winnings of lbr in chips per seat.
+struct lbr_stats_t {
+  uint64_t hands[2] = {0, 0};
+  double sum[2] = {0, 0};
+  double sum_squares[2] = {0, 0};
+};
+
+const Game *gamedef;
+
+void report(const string &name, uint64_t n, double sum, double sum_squares,
+            double big_blind);
+
+int main(int argc, char **argv) {
+  if (parse_options(argc, argv) == 1)
+    return 1;
+
+  if (!is_bundle(options.init_strategy))
+    read_game((char *)options.game_definition.c_str());
+  AgentStrategy *agent = load_agent(options.init_strategy, gamedef,
+                                    options.card_abs, options.card_abs_param,
+                                    options.action_abs,
+                                    options.action_abs_param);
+  if (gamedef->numPlayers != 2) {
+    cout << "lbr needs a two player game.\n";
+    return 1;
+  }
+
+  // the handranks table ranks holdem hands, other games use the acpc
+  // evaluator.
+  ecalc::Handranks *handranks = NULL;
+  if (gamedef->numHoleCards == 2 &&
+      sumBoardCards(gamedef, gamedef->numRounds - 1) == 5) {
+    cout << "loading handranks from: " << options.handranks_path << "\n";
+    handranks = new ecalc::Handranks(options.handranks_path.c_str());
+  }
+
+  LocalBestResponse lbr(gamedef, *agent, handranks,
+                        str_to_dbl_list(options.bets, ','), options.rollouts);
+
+  // thread t plays hands t, t + nb_threads, ... with its own stream of
+  // --seed.
+  auto start = ch::steady_clock::now();
+  vector<lbr_stats_t> stats(options.nb_threads);
+  vector<std::thread> threads(options.nb_threads);
+  for (int t = 0; t < options.nb_threads; ++t) {
+    threads[t] = std::thread([&lbr, &stats, t] {
+      nbgen rng = make_rng_stream(options.seed, t);
+      for (uint64_t h = t; h < options.nb_hands; h += options.nb_threads) {
+        unsigned seat = h % 2;
+        double won = lbr.play_hand(h, seat, rng);
+        ++stats[t].hands[seat];
+        stats[t].sum[seat] += won;
+        stats[t].sum_squares[seat] += won * won;
+      }
+    });
+  }
+  for (int t = 0; t < options.nb_threads; ++t)
+    threads[t].join();
+  double seconds =
+      ch::duration<double>(ch::steady_clock::now() - start).count();
+
+  lbr_stats_t total;
+  for (int t = 0; t < options.nb_threads; ++t)
+    for (int s = 0; s < 2; ++s) {
+      total.hands[s] += stats[t].hands[s];
+      total.sum[s] += stats[t].sum[s];
+      total.sum_squares[s] += stats[t].sum_squares[s];
+    }
+
+  double big_blind = std::max(gamedef->blind[0], gamedef->blind[1]);
+  cout << "played " << options.nb_hands << " hands in " << seconds << "s ("
+       << options.nb_hands / seconds << " hands/s)\n";
+  report("lbr", total.hands[0] + total.hands[1], total.sum[0] + total.sum[1],
+         total.sum_squares[0] + total.sum_squares[1], big_blind);
+  for (int s = 0; s < 2; ++s)
+    report("lbr in seat " + std::to_string(s), total.hands[s], total.sum[s],
+           total.sum_squares[s], big_blind);
+
+  delete handranks;
+  return 0;
+}
+
+// prints the mean winnings in milli big blinds per game with a 95%
+// confidence interval.
+void report(const string &name, uint64_t n, double sum, double sum_squares,
+            double big_blind) {
+  if (n == 0)
+    return;
+  double mean = sum / n;
+  double variance = n > 1 ? (sum_squares - n * mean * mean) / (n - 1) : 0;
+  double scale = 1000 / big_blind;
+  cout << name << ": " << mean * scale << " +- "
+       << 1.96 * std::sqrt(std::max(variance, 0.0) / n) * scale
+       << " mbb/g over " << n << " hands\n";
+}
+
+int parse_options(int argc, char **argv) {
+  try {
+    po::options_description desc("Allowed options");
+    desc.add_options()("help,h", "produce help message")(
+        "card-abstraction,c", po::value<string>(),
+        "set card abstraction to use")("action-abstraction,a",
+                                       po::value<string>(),
+                                       "set action abstraction to use")(
+        "action-abstraction-param,n",
+        po::value<string>(&options.action_abs_param),
+        "parameter passed to the action abstraction.")(
+        "card-abs-param,m", po::value<string>(&options.card_abs_param),
+        "parameter for card abstraction")(
+        "init-stategy,i", po::value<string>(&options.init_strategy),
+        "bundle, checkpoint or policy to evaluate")(
+        "gamedef,g", po::value<string>(&options.game_definition),
+        "gamedefinition to use")(
+        "handranks", po::value<string>(&options.handranks_path),
+        "path to handranks file. (if not installed)")(
+        "hands", po::value<uint64_t>(&options.nb_hands),
+        "number of hands to play. default: 1000000")(
+        "threads", po::value<int>(&options.nb_threads),
+        "set number of threads to use. default: 1")(
+        "seed", po::value<unsigned>(&options.seed),
+        "base seed of the random streams of the threads. default: 0")(
+        "bets", po::value<string>(&options.bets),
+        "raises of lbr as comma separated pot fractions, all in is always "
+        "considered. default: 1")(
+        "rollouts", po::value<unsigned>(&options.rollouts),
+        "boards sampled for the equity before the river, a missing river is "
+        "enumerated. default: 24");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("card-abstraction")) {
+      string ca = vm["card-abstraction"].as<string>();
+      if (ca == "null")
+        options.card_abs = NULLCARD_ABS;
+      else if (ca == "cluster")
+        options.card_abs = CLUSTERCARD_ABS;
+    }
+
+    if (vm.count("action-abstraction")) {
+      string ca = vm["action-abstraction"].as<string>();
+      if (ca == "null")
+        options.action_abs = NULLACTION_ABS;
+      else if (ca == "potrel")
+        options.action_abs = POTRELACTION_ABS;
+    }
+
+    if (vm.count("help")) {
+      cout << desc << "\n";
+      return 1;
+    }
+  }
+  catch (exception &e) {
+    cout << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+void read_game(char *game_definition) {
+  FILE *file = fopen(game_definition, "r");
+  if (file == NULL) {
+    std::cout << "could not read game file\n";
+    exit(-1);
+  }
+  gamedef = readGame(file);
+  if (gamedef == NULL) {
+    std::cout << "could not parse game file\n";
+    exit(-1);
+  }
+}
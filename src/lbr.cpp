@@ -0,0 +1,261 @@
+#include <algorithm>
+#include "lbr.hpp"
+#include "agent_strategy.hpp"
+#include "functions.hpp"
+#include "board_ranker.hpp"
+
+LocalBestResponse::LocalBestResponse(const Game *game,
+                                     const AgentStrategy &agent,
+                                     const ecalc::Handranks *handranks,
+                                     const std::vector<double> &bet_fractions,
+                                     unsigned nb_rollouts)
+    : game(game), agent(agent), handranks(handranks),
+      bet_fractions(bet_fractions), nb_rollouts(nb_rollouts) {
+  card_c deck;
+  for (int r = 0; r < game->numRanks; ++r)
+    for (int s = 0; s < game->numSuits; ++s)
+      deck.push_back(makeCard(r, s));
+  hands = deck_to_combinations(game->numHoleCards, deck);
+}
+
+double LocalBestResponse::play_hand(uint32_t hand_id, unsigned lbr_seat,
+                                    nbgen &rng) const {
+  State state;
+  initState(game, hand_id, &state);
+
+  card_c deck;
+  for (int r = 0; r < game->numRanks; ++r)
+    for (int s = 0; s < game->numSuits; ++s)
+      deck.push_back(makeCard(r, s));
+  unsigned next = 0;
+  auto draw = [&]() {
+    std::swap(deck[next], deck[next + rng() % (deck.size() - next)]);
+    return deck[next++];
+  };
+  for (int p = 0; p < game->numPlayers; ++p)
+    for (int c = 0; c < game->numHoleCards; ++c)
+      state.holeCards[p][c] = draw();
+  for (int c = 0; c < sumBoardCards(game, game->numRounds - 1); ++c)
+    state.boardCards[c] = draw();
+
+  // the agent cannot hold the cards of lbr or the board.
+  std::vector<double> range(hands.size(), 1.0);
+  for (unsigned h = 0; h < hands.size(); ++h)
+    if (holds_card(hands[h], state.holeCards[lbr_seat], game->numHoleCards))
+      range[h] = 0;
+
+  unsigned agent_seat = 1 - lbr_seat;
+  tree_cursor_t cursor;
+  int round = -1;
+  while (!stateFinished(&state)) {
+    if (state.round != round) {
+      round = state.round;
+      for (unsigned h = 0; h < hands.size(); ++h)
+        if (holds_card(hands[h], state.boardCards,
+                       sumBoardCards(game, round)))
+          range[h] = 0;
+    }
+
+    Action action = currentPlayer(game, &state) == lbr_seat
+                        ? best_action(state, lbr_seat, cursor, range, rng)
+                        : agent_action(state, agent_seat, cursor, range, rng);
+    doAction(game, &action, &state);
+  }
+  return valueOfState(game, &state, lbr_seat);
+}
+
+// utilities are relative to folding now. a call wins the pot or loses the
+// amount asked, a raise wins the pot if the agent folds and is checked down
+// otherwise.
+Action LocalBestResponse::best_action(const State &state, unsigned lbr_seat,
+                                      tree_cursor_t &cursor,
+                                      const std::vector<double> &range,
+                                      nbgen &rng) const {
+  double pot = state.spent[0] + state.spent[1];
+  double asked = state.maxSpent - state.spent[lbr_seat];
+  double win = equity(state, lbr_seat, range, rng);
+
+  Action best;
+  best.type = a_call;
+  best.size = 0;
+  double best_value = win * pot - (1 - win) * asked;
+
+  std::vector<int32_t> sizes;
+  int32_t min_size, max_size;
+  if (raiseIsValid(game, &state, &min_size, &max_size)) {
+    if (game->bettingType == limitBetting) {
+      sizes.push_back(0);
+    } else {
+      for (unsigned i = 0; i < bet_fractions.size(); ++i) {
+        int32_t size = state.maxSpent + bet_fractions[i] * pot;
+        sizes.push_back(std::min(std::max(size, min_size), max_size));
+      }
+      sizes.push_back(max_size);
+      std::sort(sizes.begin(), sizes.end());
+      sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+    }
+  }
+
+  // the cursor of the chosen raise is kept, so the agent answers in the
+  // node the fold probabilities were read from.
+  tree_cursor_t best_cursor;
+  std::vector<double> fold(hands.size()), called(hands.size());
+  for (unsigned i = 0; i < sizes.size(); ++i) {
+    Action raise;
+    raise.type = a_raise;
+    raise.size = sizes[i];
+    State next(state);
+    doAction(game, &raise, &next);
+    tree_cursor_t raise_cursor = cursor;
+    if (!fold_probabilities(next, 1 - lbr_seat, raise_cursor, range, fold,
+                            rng))
+      continue;
+
+    double total = 0, folded = 0;
+    for (unsigned h = 0; h < hands.size(); ++h) {
+      total += range[h];
+      folded += range[h] * fold[h];
+      called[h] = range[h] * (1 - fold[h]);
+    }
+    if (total <= 0)
+      continue;
+
+    double fold_p = folded / total;
+    double called_win = equity(state, lbr_seat, called, rng);
+    double raised = next.maxSpent - state.maxSpent;
+    double value = fold_p * pot +
+                   (1 - fold_p) * (called_win * (pot + raised) -
+                                   (1 - called_win) * (asked + raised));
+    if (value > best_value) {
+      best_value = value;
+      best = raise;
+      best_cursor = raise_cursor;
+    }
+  }
+
+  if (asked > 0 && best_value < 0) {
+    best.type = a_fold;
+    best.size = 0;
+  }
+  if (best.type == a_raise)
+    cursor = best_cursor;
+  return best;
+}
+
+Action LocalBestResponse::agent_action(const State &state,
+                                       unsigned agent_seat,
+                                       tree_cursor_t &cursor,
+                                       std::vector<double> &range,
+                                       nbgen &rng) const {
+  MatchState match;
+  match.state = state;
+  match.viewingPlayer = agent_seat;
+  uint32_t node = agent.lookup(match, cursor, rng);
+
+  Action action;
+  if (node != FlatTree::NO_NODE) {
+    std::vector<double> strategy = agent.strategy(node, match);
+    double dart = rng() / (rng.max() + 1.0);
+    unsigned a = 0;
+    for (; a + 1 < strategy.size(); ++a) {
+      dart -= strategy[a];
+      if (dart < 0)
+        break;
+    }
+
+    // raises of the abstract tree are moved to the nearest valid size.
+    action = agent.action(node, a);
+    if (isValidAction(game, &state, 1, &action)) {
+      card_c board = board_cards(state);
+      for (unsigned h = 0; h < hands.size(); ++h)
+        if (range[h] > 0)
+          range[h] *= agent.strategy(node, hands[h], board, state.round)[a];
+      return action;
+    }
+  }
+
+  // off the tree the agent calls, which says nothing about its cards.
+  action.type = a_call;
+  action.size = 0;
+  return action;
+}
+
+bool LocalBestResponse::fold_probabilities(const State &state,
+                                           unsigned agent_seat,
+                                           tree_cursor_t &cursor,
+                                           const std::vector<double> &range,
+                                           std::vector<double> &fold,
+                                           nbgen &rng) const {
+  MatchState match;
+  match.state = state;
+  match.viewingPlayer = agent_seat;
+  uint32_t node = agent.lookup(match, cursor, rng);
+  if (node == FlatTree::NO_NODE)
+    return false;
+
+  card_c board = board_cards(state);
+  for (unsigned h = 0; h < hands.size(); ++h) {
+    fold[h] = 0;
+    if (range[h] <= 0)
+      continue;
+    std::vector<double> strategy =
+        agent.strategy(node, hands[h], board, state.round);
+    for (unsigned a = 0; a < strategy.size(); ++a)
+      if (agent.action(node, a).type == a_fold)
+        fold[h] += strategy[a];
+  }
+  return true;
+}
+
+double LocalBestResponse::equity(const State &state, unsigned lbr_seat,
+                                 const std::vector<double> &range,
+                                 nbgen &rng) const {
+  int nb_known = sumBoardCards(game, state.round);
+  int nb_board = sumBoardCards(game, game->numRounds - 1);
+  int nb_missing = nb_board - nb_known;
+  const uint8_t *hole = state.holeCards[lbr_seat];
+
+  uint8_t board[MAX_BOARD_CARDS];
+  std::copy(state.boardCards, state.boardCards + nb_known, board);
+  card_c deck;
+  for (int r = 0; r < game->numRanks; ++r)
+    for (int s = 0; s < game->numSuits; ++s) {
+      uint8_t card = makeCard(r, s);
+      if (!std::count(hole, hole + game->numHoleCards, card) &&
+          !std::count(board, board + nb_known, card))
+        deck.push_back(card);
+    }
+
+  // a single missing card is enumerated, more are sampled.
+  unsigned nb_samples = nb_missing == 0 ? 1 : nb_missing == 1
+                                                  ? deck.size()
+                                                  : nb_rollouts;
+  double win = 0, total = 0;
+  for (unsigned s = 0; s < nb_samples; ++s) {
+    if (nb_missing == 1) {
+      board[nb_known] = deck[s];
+    } else {
+      for (int k = 0; k < nb_missing; ++k) {
+        std::swap(deck[k], deck[k + rng() % (deck.size() - k)]);
+        board[nb_known + k] = deck[k];
+      }
+    }
+
+    BoardRanker ranker(handranks, board, nb_board, game->numHoleCards);
+    int own = ranker(hole);
+    for (unsigned h = 0; h < hands.size(); ++h) {
+      if (range[h] <= 0 ||
+          holds_card(hands[h], board + nb_known, nb_missing))
+        continue;
+      int other = ranker(hands[h].data());
+      win += range[h] * (own > other ? 1 : own == other ? 0.5 : 0);
+      total += range[h];
+    }
+  }
+  return total > 0 ? win / total : 0.5;
+}
+
+card_c LocalBestResponse::board_cards(const State &state) const {
+  return card_c(state.boardCards,
+                state.boardCards + sumBoardCards(game, state.round));
+}
@@ -0,0 +1,250 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <boost/program_options.hpp>
+#include "cfrm.hpp"
+#include "agent_strategy.hpp"
+#include "match.hpp"
+#include "functions.hpp"
+#include "main_functions.hpp"
+
+using namespace std;
+namespace ch = std::chrono;
+namespace po = boost::program_options;
+
+int parse_options(int argc, char **argv);
+void read_game(char *game_definition);
+
+struct {
+  string game_definition = "games/holdem.limit.2p.reverse_blinds.game";
+  string handranks_path = "/usr/local/freedom/data/handranks.dat";
+
+  // abstractions of checkpoints and policies, bundles bring their own.
+  card_abstraction card_abs = CLUSTERCARD_ABS;
+  action_abstraction action_abs = NULLACTION_ABS;
+  string card_abs_param = "";
+  string action_abs_param = "";
+
+  string first_strategy = "";
+  string second_strategy = "";
+
+  // every deal is played twice.
+  uint64_t nb_deals = 500000;
+  int nb_threads = 1;
+  uint64_t seed = 0;
+  unsigned rollouts = 64;
+} options;
+
+// winnings of the first agent in chips.
+struct estimate_t {
+  uint64_t n = 0;
+  double sum = 0;
+  double sum_squares = 0;
+
+  void add(double x) {
+    ++n;
+    sum += x;
+    sum_squares += x * x;
+  }
+  void add(const estimate_t &other) {
+    n += other.n;
+    sum += other.sum;
+    sum_squares += other.sum_squares;
+  }
+};
+
+// plain: every hand on its own, duplicate: the mean of both seatings of a
+// deal, aivat: the same with the control variate.
+struct match_stats_t {
+  estimate_t plain, duplicate, aivat;
+};
+
+const Game *gamedef;
+
+bool same_game(const Game *a, const Game *b);
+void report(const string &name, const estimate_t &e, double big_blind);
+
+int main(int argc, char **argv) {
+  if (parse_options(argc, argv) == 1)
+    return 1;
+
+  if (!is_bundle(options.first_strategy) ||
+      !is_bundle(options.second_strategy))
+    read_game((char *)options.game_definition.c_str());
+  const Game *second_gamedef = gamedef;
+  AgentStrategy *first = load_agent(options.first_strategy, gamedef,
+                                    options.card_abs, options.card_abs_param,
+                                    options.action_abs,
+                                    options.action_abs_param);
+  AgentStrategy *second = load_agent(
+      options.second_strategy, second_gamedef, options.card_abs,
+      options.card_abs_param, options.action_abs, options.action_abs_param);
+  if (!same_game(gamedef, second_gamedef)) {
+    cout << "the strategies were computed for different games.\n";
+    return 1;
+  }
+  if (gamedef->numPlayers != 2) {
+    cout << "match needs a two player game.\n";
+    return 1;
+  }
+
+  // the handranks table ranks holdem hands, other games use the acpc
+  // evaluator.
+  ecalc::Handranks *handranks = NULL;
+  if (gamedef->numHoleCards == 2 &&
+      sumBoardCards(gamedef, gamedef->numRounds - 1) == 5) {
+    cout << "loading handranks from: " << options.handranks_path << "\n";
+    handranks = new ecalc::Handranks(options.handranks_path.c_str());
+  }
+
+  HeadToHead match(gamedef, *first, *second, handranks, options.rollouts);
+
+  // thread t plays deals t, t + nb_threads, ... the cards and actions of a
+  // deal do not depend on the thread.
+  auto start = ch::steady_clock::now();
+  vector<match_stats_t> stats(options.nb_threads);
+  vector<std::thread> threads(options.nb_threads);
+  for (int t = 0; t < options.nb_threads; ++t) {
+    threads[t] = std::thread([&match, &stats, t] {
+      for (uint64_t d = t; d < options.nb_deals; d += options.nb_threads) {
+        HeadToHead::deal_result_t r = match.play_deal(d, options.seed);
+        stats[t].plain.add(r.won[0]);
+        stats[t].plain.add(r.won[1]);
+        stats[t].duplicate.add((r.won[0] + r.won[1]) / 2);
+        stats[t].aivat.add((r.corrected[0] + r.corrected[1]) / 2);
+      }
+    });
+  }
+  for (int t = 0; t < options.nb_threads; ++t)
+    threads[t].join();
+  double seconds =
+      ch::duration<double>(ch::steady_clock::now() - start).count();
+
+  match_stats_t total;
+  for (int t = 0; t < options.nb_threads; ++t) {
+    total.plain.add(stats[t].plain);
+    total.duplicate.add(stats[t].duplicate);
+    total.aivat.add(stats[t].aivat);
+  }
+
+  double big_blind = std::max(gamedef->blind[0], gamedef->blind[1]);
+  cout << "played " << 2 * options.nb_deals << " hands in " << seconds
+       << "s (" << 2 * options.nb_deals / seconds << " hands/s)\n"
+       << "winnings of " << options.first_strategy << " against "
+       << options.second_strategy << ":\n";
+  report("plain", total.plain, big_blind);
+  report("duplicate", total.duplicate, big_blind);
+  report("duplicate aivat", total.aivat, big_blind);
+
+  delete handranks;
+  return 0;
+}
+
+bool same_game(const Game *a, const Game *b) {
+  if (a->bettingType != b->bettingType || a->numPlayers != b->numPlayers ||
+      a->numRounds != b->numRounds || a->numSuits != b->numSuits ||
+      a->numRanks != b->numRanks || a->numHoleCards != b->numHoleCards)
+    return false;
+  for (int p = 0; p < a->numPlayers; ++p)
+    if (a->stack[p] != b->stack[p] || a->blind[p] != b->blind[p])
+      return false;
+  for (int r = 0; r < a->numRounds; ++r)
+    if (a->numBoardCards[r] != b->numBoardCards[r] ||
+        a->firstPlayer[r] != b->firstPlayer[r] ||
+        a->maxRaises[r] != b->maxRaises[r] ||
+        (a->bettingType == limitBetting &&
+         a->raiseSize[r] != b->raiseSize[r]))
+      return false;
+  return true;
+}
+
+// prints the mean winnings in milli big blinds per game with a 95%
+// confidence interval.
+void report(const string &name, const estimate_t &e, double big_blind) {
+  if (e.n == 0)
+    return;
+  double mean = e.sum / e.n;
+  double variance =
+      e.n > 1 ? (e.sum_squares - e.n * mean * mean) / (e.n - 1) : 0;
+  double scale = 1000 / big_blind;
+  cout << name << ": " << mean * scale << " +- "
+       << 1.96 * std::sqrt(std::max(variance, 0.0) / e.n) * scale
+       << " mbb/g over " << e.n << " samples\n";
+}
+
+int parse_options(int argc, char **argv) {
+  try {
+    po::options_description desc("Allowed options");
+    desc.add_options()("help,h", "produce help message")(
+        "card-abstraction,c", po::value<string>(),
+        "set card abstraction to use")("action-abstraction,a",
+                                       po::value<string>(),
+                                       "set action abstraction to use")(
+        "action-abstraction-param,n",
+        po::value<string>(&options.action_abs_param),
+        "parameter passed to the action abstraction.")(
+        "card-abs-param,m", po::value<string>(&options.card_abs_param),
+        "parameter for card abstraction")(
+        "init-stategy,i", po::value<string>(&options.first_strategy),
+        "bundle, checkpoint or policy of the first agent")(
+        "opponent,j", po::value<string>(&options.second_strategy),
+        "bundle, checkpoint or policy of the second agent")(
+        "gamedef,g", po::value<string>(&options.game_definition),
+        "gamedefinition to use")(
+        "handranks", po::value<string>(&options.handranks_path),
+        "path to handranks file. (if not installed)")(
+        "deals", po::value<uint64_t>(&options.nb_deals),
+        "number of deals, each is played in both seats. default: 500000")(
+        "threads", po::value<int>(&options.nb_threads),
+        "set number of threads to use. default: 1")(
+        "seed", po::value<uint64_t>(&options.seed),
+        "seed of the deals. default: 0")(
+        "rollouts", po::value<unsigned>(&options.rollouts),
+        "boards sampled for the equity if more than two board cards are "
+        "missing. default: 64");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("card-abstraction")) {
+      string ca = vm["card-abstraction"].as<string>();
+      if (ca == "null")
+        options.card_abs = NULLCARD_ABS;
+      else if (ca == "cluster")
+        options.card_abs = CLUSTERCARD_ABS;
+    }
+
+    if (vm.count("action-abstraction")) {
+      string ca = vm["action-abstraction"].as<string>();
+      if (ca == "null")
+        options.action_abs = NULLACTION_ABS;
+      else if (ca == "potrel")
+        options.action_abs = POTRELACTION_ABS;
+    }
+
+    if (vm.count("help")) {
+      cout << desc << "\n";
+      return 1;
+    }
+  }
+  catch (exception &e) {
+    cout << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+void read_game(char *game_definition) {
+  FILE *file = fopen(game_definition, "r");
+  if (file == NULL) {
+    std::cout << "could not read game file\n";
+    exit(-1);
+  }
+  gamedef = readGame(file);
+  if (gamedef == NULL) {
+    std::cout << "could not parse game file\n";
+    exit(-1);
+  }
+}
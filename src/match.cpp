@@ -0,0 +1,168 @@
+#include <algorithm>
+#include "match.hpp"
+#include "agent_strategy.hpp"
+#include "functions.hpp"
+#include "board_ranker.hpp"
+
+HeadToHead::HeadToHead(const Game *game, const AgentStrategy &first,
+                       const AgentStrategy &second,
+                       const ecalc::Handranks *handranks, unsigned nb_rollouts)
+    : game(game), agents{&first, &second}, handranks(handranks),
+      nb_rollouts(nb_rollouts) {}
+
+HeadToHead::deal_result_t HeadToHead::play_deal(uint64_t deal_id,
+                                                uint64_t seed) const {
+  nbgen rng = make_rng_stream(seed, deal_id);
+
+  State state;
+  initState(game, deal_id, &state);
+  card_c deck;
+  for (int r = 0; r < game->numRanks; ++r)
+    for (int s = 0; s < game->numSuits; ++s)
+      deck.push_back(makeCard(r, s));
+  unsigned next = 0;
+  auto draw = [&]() {
+    std::swap(deck[next], deck[next + rng() % (deck.size() - next)]);
+    return deck[next++];
+  };
+  for (int p = 0; p < game->numPlayers; ++p)
+    for (int c = 0; c < game->numHoleCards; ++c)
+      state.holeCards[p][c] = draw();
+  for (int c = 0; c < sumBoardCards(game, game->numRounds - 1); ++c)
+    state.boardCards[c] = draw();
+
+  // the cards of a seat are the same in both hands, so are the equities.
+  double equity[MAX_ROUNDS];
+  for (int r = 0; r < game->numRounds; ++r)
+    equity[r] = showdown_equity(state, r, rng);
+
+  deal_result_t result;
+  for (unsigned seat = 0; seat < 2; ++seat)
+    play_hand(state, seat, equity, rng, result.won[seat],
+              result.corrected[seat]);
+  return result;
+}
+
+// the correction of a decision is the expected value of the acting agent's
+// strategy minus the value of the sampled action, the correction of a chance
+// node the equity before the cards minus the one after them. action values
+// are taken before the cards of the next round.
+void HeadToHead::play_hand(State state, unsigned seat, const double *equity,
+                           nbgen &rng, double &won, double &corrected) const {
+  tree_cursor_t cursors[2];
+  double correction = 0;
+  while (!stateFinished(&state)) {
+    unsigned player = currentPlayer(game, &state);
+    const AgentStrategy &agent = *agents[player == seat ? 0 : 1];
+    MatchState match;
+    match.state = state;
+    match.viewingPlayer = player;
+    uint32_t node = agent.lookup(match, cursors[player], rng);
+
+    Action action;
+    action.type = a_call;
+    action.size = 0;
+    if (node != FlatTree::NO_NODE) {
+      std::vector<double> strategy = agent.strategy(node, match);
+      double dart = rng() / (rng.max() + 1.0);
+      double expected = 0;
+      bool chosen = false;
+      for (unsigned a = 0; a < strategy.size(); ++a) {
+        Action played = played_action(state, agent, node, a);
+        State next(state);
+        doAction(game, &played, &next);
+        expected += strategy[a] * value(next, state.round, seat, equity);
+
+        dart -= strategy[a];
+        if (!chosen && (dart < 0 || a + 1 == strategy.size())) {
+          action = played;
+          chosen = true;
+        }
+      }
+      State next(state);
+      doAction(game, &action, &next);
+      correction += expected - value(next, state.round, seat, equity);
+    }
+    // off the tree the agent calls, there is nothing to correct.
+
+    int round = state.round;
+    doAction(game, &action, &state);
+    if (stateFinished(&state) || state.round != round) {
+      double after = stateFinished(&state)
+                         ? valueOfState(game, &state, seat)
+                         : value(state, state.round, seat, equity);
+      correction += value(state, round, seat, equity) - after;
+    }
+  }
+  won = valueOfState(game, &state, seat);
+  corrected = won + correction;
+}
+
+Action HeadToHead::played_action(const State &state,
+                                 const AgentStrategy &agent, uint32_t node,
+                                 unsigned i) const {
+  Action action = agent.action(node, i);
+  if (!isValidAction(game, &state, 1, &action)) {
+    action.type = a_call;
+    action.size = 0;
+  }
+  return action;
+}
+
+double HeadToHead::value(const State &state, int round, unsigned seat,
+                         const double *equity) const {
+  if (state.playerFolded[0] || state.playerFolded[1])
+    return valueOfState(game, &state, seat);
+  double win = seat == 0 ? equity[round] : 1 - equity[round];
+  return win * (state.spent[0] + state.spent[1]) - state.spent[seat];
+}
+
+double HeadToHead::showdown_equity(const State &state, int round,
+                                   nbgen &rng) const {
+  int nb_known = sumBoardCards(game, round);
+  int nb_board = sumBoardCards(game, game->numRounds - 1);
+  int nb_missing = nb_board - nb_known;
+
+  uint8_t board[MAX_BOARD_CARDS];
+  std::copy(state.boardCards, state.boardCards + nb_known, board);
+  card_c deck;
+  for (int r = 0; r < game->numRanks; ++r)
+    for (int s = 0; s < game->numSuits; ++s) {
+      uint8_t card = makeCard(r, s);
+      bool dealt = std::count(board, board + nb_known, card) > 0;
+      for (int p = 0; p < 2; ++p)
+        dealt |= std::count(state.holeCards[p],
+                            state.holeCards[p] + game->numHoleCards, card) > 0;
+      if (!dealt)
+        deck.push_back(card);
+    }
+
+  auto score = [&]() {
+    BoardRanker ranker(handranks, board, nb_board, game->numHoleCards);
+    int first = ranker(state.holeCards[0]);
+    int second = ranker(state.holeCards[1]);
+    return first > second ? 1.0 : first == second ? 0.5 : 0.0;
+  };
+
+  if (nb_missing == 0)
+    return score();
+
+  // up to two missing cards are enumerated, more are sampled.
+  double win = 0;
+  if (nb_missing <= 2) {
+    hand_list boards = deck_to_combinations(nb_missing, deck);
+    for (unsigned b = 0; b < boards.size(); ++b) {
+      std::copy(boards[b].begin(), boards[b].end(), board + nb_known);
+      win += score();
+    }
+    return win / boards.size();
+  }
+  for (unsigned s = 0; s < nb_rollouts; ++s) {
+    for (int k = 0; k < nb_missing; ++k) {
+      std::swap(deck[k], deck[k + rng() % (deck.size() - k)]);
+      board[nb_known + k] = deck[k];
+    }
+    win += score();
+  }
+  return win / nb_rollouts;
+}
@@ -1,8 +1,15 @@
 #include <iostream>
 #include <chrono>
 #include <fstream>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <boost/program_options.hpp>
 #include "cfrm.hpp"
+#include "agent_strategy.hpp"
 #include "functions.hpp"
 #include "main_functions.hpp"
 
@@ -10,8 +17,6 @@ extern "C" {
 #include "net.h"
 }
 
-#define CFR_SAMPLER ChanceSamplingCFR
-
 void threshold_strategy(std::vector<double> &strategy, double threshold) {
   double sum = 0;
   for (unsigned i = 0; i < strategy.size(); ++i) {
@@ -53,7 +58,10 @@ struct {
   string game_definition = "games/holdem.limit.2p.reverse_blinds.game";
 
   string host = "localhost";
-  unsigned port = 18791;
+  // one seat per port.
+  vector<unsigned> ports = {18791};
+  // print latency percentiles every n decisions, 0 only at the end.
+  uint64_t report_every = 0;
 
   unsigned seed = 0;
 
@@ -70,211 +78,290 @@ struct {
 
 const Game *gamedef;
 
-int main(int argc, char **argv) {
-  int sock, len, r, a;
-  int32_t min, max;
-  uint16_t port;
-  double p;
+// one dealer connection. the tree and strategy are shared by all seats,
+// every seat keeps its own match state and position in the tree.
+struct seat_t {
+  size_t id;
+  int fd;
+  unsigned port;
+  // received bytes of an incomplete line.
+  string in;
+  // responses not yet written to the dealer.
+  string out;
+  bool want_write = false;
   MatchState state;
-  Action action;
-  FILE *file, *toServer, *fromServer;
-  struct timeval tv;
-  double probs[NUM_ACTION_TYPES];
-  double actionProbs[NUM_ACTION_TYPES];
-   char line[MAX_LINE_LEN];
+  tree_cursor_t cursor;
+};
+
+AgentStrategy *agent;
 
-  /* Initialize the player's random number state using time */
+Action choose_action(MatchState &state, tree_cursor_t &cursor, nbgen &rng);
+bool read_seat(seat_t &seat);
+void serve_seat(seat_t &seat, nbgen &rng, std::vector<double> &latencies,
+                bool verbose);
+void flush_seat(seat_t &seat, int epfd);
+void report_latency(std::vector<double> &latencies);
 
+int main(int argc, char **argv) {
   if (parse_options(argc, argv) == 1)
     return 1;
 
   nbgen rng(options.seed);
-  read_game((char *)options.game_definition.c_str());
+  // a bundle has its own game definition.
+  if (!is_bundle(options.init_strategy))
+    read_game((char *)options.game_definition.c_str());
 
   if (options.threshold > 0)
     cout << "using thresholding with param: " << options.threshold << "\n";
 
-  cout << "using information abstraction type: "
-       << card_abstraction_str[options.card_abs]
-       << " with parameter: " << options.card_abs_param << "\n";
-  CardAbstraction *card_abs =
-      load_card_abstraction(gamedef, options.card_abs, options.card_abs_param);
-
-  cout << "using action abstraction type: "
-       << action_abstraction_str[options.action_abs]
-       << " with parameter: " << options.action_abs_param << "\n";
-  ActionAbstraction *action_abs = load_action_abstraction(
-      gamedef, options.action_abs, options.action_abs_param);
-
-  AbstractGame *agame = new HoldemGame(gamedef, card_abs, action_abs, NULL);
-  cout << "created holdem game tree.\n";
-  CFRM *cfr = new CFR_SAMPLER(agame, (char *)options.init_strategy.c_str());
-  cout << "CFR Initialized\n";
-  std::cout << "Number of informationsets:" << agame->get_nb_infosets() << "\n";
-  std::cout << "Number of terminalnodes:"
-            << cfr->count_terminal_nodes(agame->game_tree_root()) << "\n";
-
-  /* connect to the dealer */
-   sock = connectTo((char *)options.host.c_str(), options.port);
-   if (sock < 0) {
-   std::cout << "could not connect to socket\n";
-   exit(EXIT_FAILURE);
+  agent = load_agent(options.init_strategy, gamedef, options.card_abs,
+                     options.card_abs_param, options.action_abs,
+                     options.action_abs_param);
+
+  int epfd = epoll_create1(0);
+  if (epfd < 0) {
+    perror("ERROR: could not create epoll instance");
+    exit(EXIT_FAILURE);
   }
-   toServer = fdopen(sock, "w");
-   fromServer = fdopen(sock, "r");
-   if (toServer == NULL || fromServer == NULL) {
 
-   fprintf(stderr, "ERROR: could not get socket streams\n");
-   exit(EXIT_FAILURE);
+  // connect to the dealers and send the version string while the sockets
+  // still block.
+  std::vector<seat_t> seats(options.ports.size());
+  char version[MAX_LINE_LEN];
+  int version_len = snprintf(version, MAX_LINE_LEN,
+                             "VERSION:%" PRIu32 ".%" PRIu32 ".%" PRIu32 "\n",
+                             VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION);
+  for (size_t i = 0; i < seats.size(); ++i) {
+    seat_t &seat = seats[i];
+    seat.id = i;
+    seat.port = options.ports[i];
+    seat.fd = connectTo((char *)options.host.c_str(), seat.port);
+    if (seat.fd < 0) {
+      std::cout << "could not connect to socket " << seat.port << "\n";
+      exit(EXIT_FAILURE);
+    }
+    if (write(seat.fd, version, version_len) != version_len) {
+      fprintf(stderr, "ERROR: could not get send version to server\n");
+      exit(EXIT_FAILURE);
+    }
+    int one = 1;
+    setsockopt(seat.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(seat.fd, F_SETFL, fcntl(seat.fd, F_GETFL) | O_NONBLOCK);
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = i;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, seat.fd, &ev) != 0) {
+      perror("ERROR: could not watch socket");
+      exit(EXIT_FAILURE);
+    }
   }
+  cout << "playing at " << seats.size() << " seats\n";
+
+  // play the gamedef! every wakeup answers all complete lines of a seat
+  // with a single write. latencies holds the decisions since the last
+  // report.
+  bool verbose = seats.size() == 1;
+  std::vector<double> latencies;
+  std::vector<epoll_event> events(seats.size());
+  size_t nb_open = seats.size();
+  while (nb_open > 0) {
+    int n = epoll_wait(epfd, events.data(), events.size(), -1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("ERROR: epoll_wait failed");
+      exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < n; ++i) {
+      seat_t &seat = seats[events[i].data.u64];
+      if (events[i].events & EPOLLOUT)
+        flush_seat(seat, epfd);
+      if (!(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+        continue;
+
+      if (!read_seat(seat)) {
+        cout << "dealer at port " << seat.port << " closed the connection\n";
+        close(seat.fd);
+        --nb_open;
+        continue;
+      }
+      serve_seat(seat, rng, latencies, verbose);
+      flush_seat(seat, epfd);
+      if (options.report_every > 0 &&
+          latencies.size() >= options.report_every)
+        report_latency(latencies);
+    }
+  }
+  close(epfd);
+  report_latency(latencies);
 
-  //////[> send version string to dealer <]
-   if (fprintf(toServer, "VERSION:%" PRIu32 ".%" PRIu32 ".%" PRIu32 "\n",
-   VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION) != 14) {
+  return 0;
+}
 
-   fprintf(stderr, "ERROR: could not get send version to server\n");
-   exit(EXIT_FAILURE);
+// appends everything the dealer sent to seat.in. false if the connection
+// was closed or failed.
+bool read_seat(seat_t &seat) {
+  char buf[4096];
+  while (true) {
+    ssize_t r = read(seat.fd, buf, sizeof(buf));
+    if (r > 0) {
+      seat.in.append(buf, r);
+      continue;
+    }
+    if (r < 0 && errno == EINTR)
+      continue;
+    return r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
   }
-   fflush(toServer);
+}
 
-  // play the gamedef!
-  while (fgets(line, MAX_LINE_LEN, fromServer)) {
-    //char *line = "MATCHSTATE:0:112:cr6c/cr28:8d9s|/2hJh6h";
-    // char *line = "MATCHSTATE:1:33:c:|Qs8h";
-    //char* line = "MATCHSTATE:0:1229:cr10c/r28c/r50r126:5sQd|/8s8cAs/5c";
-     printf("%s\n",line);
+// answers the complete lines of seat.in in which the seat acts. the latency
+// of a decision is measured from the end of the read.
+void serve_seat(seat_t &seat, nbgen &rng, std::vector<double> &latencies,
+                bool verbose) {
+  auto received = ch::steady_clock::now();
+  char line[MAX_LINE_LEN];
+  size_t start = 0, end;
+  while ((end = seat.in.find('\n', start)) != string::npos) {
+    size_t line_len = end + 1 - start;
+    if (line_len >= MAX_LINE_LEN) {
+      fprintf(stderr, "ERROR: line too long from port %u\n", seat.port);
+      exit(EXIT_FAILURE);
+    }
+    memcpy(line, seat.in.data() + start, line_len);
+    line[line_len] = 0;
+    start = end + 1;
+    if (verbose)
+      printf("%s\n", line);
 
     /* ignore comments */
-    if (line[0] == '#' || line[0] == ';') {
+    if (line[0] == '#' || line[0] == ';')
       continue;
-    }
 
-    len = readMatchState(line, gamedef, &state);
+    int len = readMatchState(line, gamedef, &seat.state);
     if (len < 0) {
-
       fprintf(stderr, "ERROR: could not read state %s", line);
       exit(EXIT_FAILURE);
     }
 
-     if (stateFinished(&state.state)) {
-    //[> ignore the gamedef over message <]
-     continue;
-    }
+    if (stateFinished(&seat.state.state))
+      continue;
+    if (currentPlayer(gamedef, &seat.state.state) != seat.state.viewingPlayer)
+      continue;
+
+    // add a colon (guaranteed to fit because we read a new-line)
+    line[len] = ':';
+    ++len;
 
-     if (currentPlayer(gamedef, &state.state) != state.viewingPlayer) {
-    //[> we're not acting <]
-     continue;
+    Action action = choose_action(seat.state, seat.cursor, rng);
+    if (verbose)
+      cout << "choosen action: " << ActionsStr[action.type] << "= "
+           << action.size << "\n";
+    int r = printAction(gamedef, &action, MAX_LINE_LEN - len - 2, &line[len]);
+    if (r < 0) {
+      fprintf(stderr, "ERROR: line too long after printing action\n");
+      exit(EXIT_FAILURE);
     }
+    len += r;
+    line[len++] = '\r';
+    line[len++] = '\n';
+    seat.out.append(line, len);
+
+    latencies.push_back(
+        ch::duration<double, std::micro>(ch::steady_clock::now() - received)
+            .count());
+  }
+  seat.in.erase(0, start);
+}
 
-     //add a colon (guaranteed to fit because we read a new-line in fgets) 
-     line[len] = ':';
-    ++len;
+// writes as much of seat.out as the socket takes and waits for the socket
+// to become writable if something is left.
+void flush_seat(seat_t &seat, int epfd) {
+  while (!seat.out.empty()) {
+    ssize_t w = write(seat.fd, seat.out.data(), seat.out.size());
+    if (w > 0) {
+      seat.out.erase(0, w);
+      continue;
+    }
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      fprintf(stderr, "ERROR: could not get send response to server\n");
+      exit(EXIT_FAILURE);
+    }
+    break;
+  }
 
-    // char *c = new char[300];
-    // printState(gamedef, &state.state, 300, c);
-    // printf("%s\n", c);
-
-    // lookup current node we are in
-    InformationSetNode *curr_node = (InformationSetNode *)cfr->lookup_state(
-        &state.state, state.viewingPlayer);
-    //std::cout << "i am behind lookup\n";
-
-    // CHECK IF WE FOUND THE CORRECT NODE
-    if (curr_node != NULL) {
-      //std::cout << "lookup was successful";
-      // get strategy at curr_node
-      //
-      card_c hand(gamedef->numHoleCards);
-      for (int i = 0; i < gamedef->numHoleCards; ++i) {
-        hand[i] = state.state.holeCards[state.viewingPlayer][i];
-      }
+  bool want_write = !seat.out.empty();
+  if (want_write == seat.want_write)
+    return;
+  seat.want_write = want_write;
+  epoll_event ev;
+  ev.events = EPOLLIN | (want_write ? (uint32_t)EPOLLOUT : (uint32_t)0);
+  ev.data.u64 = seat.id;
+  if (epoll_ctl(epfd, EPOLL_CTL_MOD, seat.fd, &ev) != 0) {
+    perror("ERROR: could not watch socket");
+    exit(EXIT_FAILURE);
+  }
+}
 
-      card_c board;
-      // for (int i = 0; i < gamedef->numRounds; ++i) {
-      // if (i > state.state.round)
-      // continue;
-      for (int c = 0; c < sumBoardCards(gamedef, state.state.round); ++c) {
-        board.push_back(state.state.boardCards[c]);
-      }
-      //}
-      // std::cout << int(hand[0]) << "," << int(hand[1]) << "\n";
-      // for(unsigned i = 0; i < board.size(); ++i)
-      // std::cout << int(board[i]) << " ";
-      // std::cout << "\n";
-      //
-
-      auto strategy = cfr->get_normalized_avg_strategy(
-          curr_node->get_idx(), hand, board, state.state.round);
-
-      //cout << "prev: ";
-      //for(unsigned i = 0; i < strategy.size();++i)
-        //cout << strategy[i] << " ";
-      //cout << "\n";
-
-      if (options.threshold > 0) {
-        threshold_strategy(strategy, options.threshold);
-      }
+// prints percentiles of the decision latencies in microseconds and clears
+// them.
+void report_latency(std::vector<double> &latencies) {
+  if (latencies.empty())
+    return;
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return latencies[std::min<size_t>(latencies.size() - 1,
+                                      p * latencies.size())];
+  };
+  cout << latencies.size() << " decisions, latency in us: p50 "
+       << percentile(0.5) << " p90 " << percentile(0.9) << " p99 "
+       << percentile(0.99) << " max " << latencies.back() << "\n";
+  latencies.clear();
+}
 
-      if (options.purify > 0) {
-        purify_strategy(strategy, options.purify);
-      }
-      //cout << "thresholded: ";
-      //for(unsigned i = 0; i < strategy.size();++i)
-        //cout << strategy[i] << " ";
-      //cout << "\n";
-
-      // choose according to distribution
-      std::discrete_distribution<int> d(strategy.begin(), strategy.end());
-      int max_tries = 10;
-      do {
-        int action_idx = d(rng);
-        action = curr_node->get_children()[action_idx]->get_action();
-        --max_tries;
-        //std::cout << "#" << max_tries
-                  //<< " choosen action: " << ActionsStr[action.type] << " = "
-                  //<< action.size << "\n";
-        if(isValidAction(gamedef, &state.state, 0, &action))
-            break;
-      } while (max_tries > 0);
-      // after max tries no answer was found. jump into the fail branch.
-      if (!isValidAction(gamedef, &state.state, 0, &action))
-        goto LASTRESCUE;
-    } else {
-    LASTRESCUE:
-      std::cout
-          << "state not found in game tree. forcing first possible action.\n";
-      for (a = 0; a < NUM_ACTION_TYPES; ++a) {
-        action.type = (ActionType)a;
-        if (isValidAction(gamedef, &state.state, 0, &action))
-          break;
-      }
-      cout << "choosen action is " << ActionsStr[action.type] << "\n";
-    }
+// samples an action of the strategy at the information set of state.
+Action choose_action(MatchState &state, tree_cursor_t &cursor, nbgen &rng) {
+  Action action;
+  // lookup current node we are in, continuing from the previous lookup of
+  // this hand.
+  uint32_t curr_node = agent->lookup(state, cursor, rng);
 
-    //[> do the action! <]
-    assert(isValidAction(gamedef, &state.state, 0, &action));
-    cout << "choosen action: " << ActionsStr[action.type] << "= " << action.size << "\n";
-     r = printAction(gamedef, &action, MAX_LINE_LEN - len - 2, &line[len]);
-     if (r < 0) {
+  // CHECK IF WE FOUND THE CORRECT NODE
+  if (curr_node != FlatTree::NO_NODE) {
+    auto strategy = agent->strategy(curr_node, state);
 
-     fprintf(stderr, "ERROR: line too long after printing action\n");
-     exit(EXIT_FAILURE);
+    if (options.threshold > 0) {
+      threshold_strategy(strategy, options.threshold);
     }
-     len += r;
-     line[len] = '\r';
-    ++len;
-     line[len] = '\n';
-    ++len;
-
-     if (fwrite(line, 1, len, toServer) != len) {
 
-     fprintf(stderr, "ERROR: could not get send response to server\n");
-     exit(EXIT_FAILURE);
+    if (options.purify > 0) {
+      purify_strategy(strategy, options.purify);
     }
-     fflush(toServer);
+
+    // choose according to distribution
+    std::discrete_distribution<int> d(strategy.begin(), strategy.end());
+    int max_tries = 10;
+    do {
+      int action_idx = d(rng);
+      action = agent->action(curr_node, action_idx);
+      --max_tries;
+      if (isValidAction(gamedef, &state.state, 0, &action))
+        return action;
+    } while (max_tries > 0);
+    // after max tries no answer was found. fall through to the rescue.
   }
 
-  return 0;
+  std::cout << "state not found in game tree. forcing first possible action.\n";
+  for (int a = 0; a < NUM_ACTION_TYPES; ++a) {
+    action.type = (ActionType)a;
+    if (isValidAction(gamedef, &state.state, 0, &action))
+      break;
+  }
+  cout << "choosen action is " << ActionsStr[action.type] << "\n";
+  assert(isValidAction(gamedef, &state.state, 0, &action));
+  return action;
 }
 
 int parse_options(int argc, char **argv) {
@@ -291,9 +378,12 @@ int parse_options(int argc, char **argv) {
         "card-abs-param,m", po::value<string>(&options.card_abs_param),
         "parameter for card abstraction")(
         "host,o", po::value<string>(&options.host), "host to connect to")(
-        "port,p", po::value<unsigned>(&options.port), "port to connect to")(
+        "port,p", po::value<vector<unsigned>>(&options.ports)->multitoken(),
+        "ports to connect to, one seat per port")(
+        "report-every", po::value<uint64_t>(&options.report_every),
+        "print decision latency percentiles every n decisions")(
         "init-stategy,i", po::value<string>(&options.init_strategy),
-        "initialize regrets and avg strategy from file")(
+        "bundle, policy or checkpoint to play")(
         "gamedef,g", po::value<string>(&options.game_definition),
         "gamedefinition to use")(
         "threshold,t", po::value<double>(&options.threshold),
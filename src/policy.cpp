@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "policy.hpp"
+#include "checkpoint.hpp"
+#include "abstract_game.hpp"
+
+using std::string;
+using std::runtime_error;
+
+static uint64_t align(uint64_t offset) {
+  return (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT *
+         CHECKPOINT_ALIGNMENT;
+}
+
+// pads fs to offset bytes after base.
+static void pad_to(std::ostream &fs, uint64_t base, uint64_t offset) {
+  static const char zeros[CHECKPOINT_ALIGNMENT] = {};
+  uint64_t pos = (uint64_t)fs.tellp() - base;
+  if (pos < offset)
+    fs.write(zeros, offset - pos);
+}
+
+static void check_header(const policy_header_t &header,
+                         const string &filename) {
+  if (memcmp(header.magic, POLICY_MAGIC, sizeof(POLICY_MAGIC)) != 0)
+    throw runtime_error(filename + " is not a policy");
+  if (header.version != 1 && header.version != POLICY_VERSION)
+    throw runtime_error(filename + " has unsupported policy version " +
+                        std::to_string(header.version));
+  if (header.bits != 8 && header.bits != 16)
+    throw runtime_error(filename + " has unsupported precision " +
+                        std::to_string(header.bits));
+}
+
+bool is_policy(const string &filename) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(POLICY_MAGIC)];
+  if (!file.read(magic, sizeof(magic)))
+    return false;
+  return memcmp(magic, POLICY_MAGIC, sizeof(magic)) == 0;
+}
+
+policy_header_t read_policy_header(const string &filename) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  policy_header_t header;
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    throw runtime_error("could not read policy " + filename);
+  check_header(header, filename);
+  return header;
+}
+
+bool verify_policy(const string &filename) {
+  policy_header_t header = read_policy_header(filename);
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  std::vector<char> buf(1 << 20);
+  uint64_t bytes = header.nb_values * (header.bits / 8);
+  uint64_t hash = 14695981039346656037ULL;
+  file.seekg(header.data_offset);
+  // chunks are multiples of 8 bytes, so hashing them one after another
+  // equals hashing the section at once.
+  for (uint64_t done = 0; done < bytes; done += buf.size()) {
+    size_t n = std::min<uint64_t>(buf.size(), bytes - done);
+    if (!file.read(buf.data(), n))
+      return false;
+    hash = checksum(buf.data(), n, hash);
+  }
+  return hash == header.data_checksum;
+}
+
+// normalizes row like CFRM::get_normalized_avg_strategy.
+static void normalize_row(const entry_value_t *row, unsigned nb_entries,
+                          double *p) {
+  double sum = 0;
+  for (unsigned i = 0; i < nb_entries; ++i)
+    sum += row[i] > 0 ? row[i] : 0;
+  for (unsigned i = 0; i < nb_entries; ++i)
+    p[i] = sum > 0 ? (row[i] > 0 ? row[i] / sum : 0) : 1.0 / nb_entries;
+}
+
+template <class T>
+static void quantize(const double *p, unsigned nb_entries, std::vector<T> &out) {
+  const double scale = (T)-1;
+  for (unsigned i = 0; i < nb_entries; ++i)
+    out.push_back((T)std::lround(p[i] * scale));
+}
+
+// quantizes the stored rows and fills in the index and, if rows are pruned,
+// the masks.
+template <class T>
+static std::vector<T> quantize_store(const entry_c &avg_strategy,
+                                     const std::vector<double> &reach,
+                                     double threshold,
+                                     std::vector<policy_index_t> &index,
+                                     std::vector<uint64_t> &masks) {
+  bool prune = !reach.empty() && threshold > 0;
+  std::vector<T> data;
+  double p[MAX_ABSTRACT_ACTIONS], fallback[MAX_ABSTRACT_ACTIONS];
+  for (size_t i = 0; i < avg_strategy.size(); ++i) {
+    entry_t e = avg_strategy[i];
+    index[i] = {data.size(), e.nb_buckets, e.nb_entries};
+    size_t first_word = masks.size();
+    if (prune)
+      masks.resize(masks.size() + (e.nb_buckets + 63) / 64, 0);
+
+    unsigned nb_pruned = 0;
+    double pruned_reach = 0;
+    std::fill(fallback, fallback + e.nb_entries, 0);
+    for (unsigned b = 0; b < e.nb_buckets; ++b) {
+      normalize_row(e.row(b), e.nb_entries, p);
+      double r = prune ? reach[avg_strategy.row_index(i, b)] : 0;
+      if (!prune || r >= threshold) {
+        if (prune)
+          masks[first_word + b / 64] |= 1ULL << (b % 64);
+        quantize(p, e.nb_entries, data);
+        continue;
+      }
+      // rows nobody reaches get a tiny weight, so they only decide the
+      // fallback of an information set nobody reaches.
+      double w = r > 0 ? r : 1e-300;
+      for (unsigned a = 0; a < e.nb_entries; ++a)
+        fallback[a] += w * p[a];
+      pruned_reach += w;
+      ++nb_pruned;
+    }
+    if (nb_pruned > 0) {
+      for (unsigned a = 0; a < e.nb_entries; ++a)
+        fallback[a] /= pruned_reach;
+      quantize(fallback, e.nb_entries, data);
+    }
+  }
+  return data;
+}
+
+void write_policy(std::ostream &fs, const entry_c &avg_strategy,
+                  unsigned bits, const std::vector<double> &reach,
+                  double threshold) {
+  if (bits != 8 && bits != 16)
+    throw runtime_error("policies have 8 or 16 bits per probability");
+  if (!reach.empty() && reach.size() != avg_strategy.rows())
+    throw runtime_error("reach does not match the average strategy");
+
+  std::vector<policy_index_t> index(avg_strategy.size());
+  std::vector<uint64_t> masks;
+  std::vector<uint8_t> data8;
+  std::vector<uint16_t> data16;
+  const char *data;
+  size_t data_bytes;
+  if (bits == 8) {
+    data8 = quantize_store<uint8_t>(avg_strategy, reach, threshold, index,
+                                    masks);
+    data = reinterpret_cast<const char *>(data8.data());
+    data_bytes = data8.size();
+  } else {
+    data16 = quantize_store<uint16_t>(avg_strategy, reach, threshold, index,
+                                      masks);
+    data = reinterpret_cast<const char *>(data16.data());
+    data_bytes = data16.size() * sizeof(uint16_t);
+  }
+  size_t index_bytes = index.size() * sizeof(policy_index_t);
+  size_t mask_bytes = masks.size() * sizeof(uint64_t);
+
+  policy_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, POLICY_MAGIC, sizeof(POLICY_MAGIC));
+  header.version = POLICY_VERSION;
+  header.bits = bits;
+  header.fingerprint = layout_fingerprint(avg_strategy);
+  header.nb_infosets = index.size();
+  header.nb_values = data_bytes / (bits / 8);
+  header.index_offset = CHECKPOINT_ALIGNMENT;
+  uint64_t end = header.index_offset + index_bytes;
+  if (!masks.empty()) {
+    header.mask_offset = align(end);
+    header.nb_mask_words = masks.size();
+    end = header.mask_offset + mask_bytes;
+  }
+  header.data_offset = align(end);
+  header.index_checksum = checksum(masks.data(), mask_bytes,
+                                   checksum(index.data(), index_bytes));
+  header.data_checksum = checksum(data, data_bytes);
+
+  uint64_t base = fs.tellp();
+  fs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  pad_to(fs, base, header.index_offset);
+  fs.write(reinterpret_cast<const char *>(index.data()), index_bytes);
+  if (!masks.empty()) {
+    pad_to(fs, base, header.mask_offset);
+    fs.write(reinterpret_cast<const char *>(masks.data()), mask_bytes);
+  }
+  pad_to(fs, base, header.data_offset);
+  fs.write(data, data_bytes);
+}
+
+void write_policy(const string &filename, const entry_c &avg_strategy,
+                  unsigned bits, const std::vector<double> &reach,
+                  double threshold) {
+  string tmpfile = filename + ".tmp";
+  std::ofstream fs(tmpfile.c_str(), std::ios::out | std::ios::binary);
+  write_policy(fs, avg_strategy, bits, reach, threshold);
+  fs.close();
+  if (!fs)
+    throw runtime_error("could not write policy " + tmpfile);
+  if (rename(tmpfile.c_str(), filename.c_str()) != 0)
+    throw runtime_error("could not rename " + tmpfile + " to " + filename);
+}
+
+Policy::Policy(AbstractGame *game, const string &filename)
+    : index(NULL), masks(NULL), data(NULL), mapping(MAP_FAILED),
+      mapped_bytes(0) {
+  header = read_policy_header(filename);
+
+  // only the dimensions are needed to check the fingerprint.
+  entry_c regrets(game->get_nb_infosets()),
+      avg_strategy(game->get_nb_infosets());
+  game->game_tree_root()->init_entries(
+      regrets, avg_strategy, game->get_gamedef(), game->card_abstraction());
+  if (header.fingerprint != layout_fingerprint(avg_strategy))
+    throw runtime_error(filename + " was written for another game or "
+                                   "abstraction");
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw runtime_error("could not open policy " + filename);
+  struct stat st;
+  size_t end = header.data_offset + header.nb_values * (header.bits / 8);
+  if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < end) {
+    close(fd);
+    throw runtime_error("truncated policy " + filename);
+  }
+  mapped_bytes = st.st_size;
+  mapping = mmap(NULL, mapped_bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    throw runtime_error("could not map policy " + filename);
+
+  try {
+    attach(static_cast<const uint8_t *>(mapping), "policy " + filename);
+  } catch (...) {
+    munmap(mapping, mapped_bytes);
+    throw;
+  }
+}
+
+Policy::Policy(const void *image, size_t bytes, uint64_t fingerprint)
+    : index(NULL), masks(NULL), data(NULL), mapping(MAP_FAILED),
+      mapped_bytes(bytes) {
+  const string name = "embedded policy";
+  if (bytes < sizeof(header))
+    throw runtime_error("truncated " + name);
+  memcpy(&header, image, sizeof(header));
+  check_header(header, name);
+  if (header.fingerprint != fingerprint)
+    throw runtime_error(name + " was written for another game or "
+                               "abstraction");
+  if (bytes < header.data_offset + header.nb_values * (header.bits / 8))
+    throw runtime_error("truncated " + name);
+  attach(static_cast<const uint8_t *>(image), name);
+}
+
+void Policy::attach(const uint8_t *base, const string &name) {
+  index = reinterpret_cast<const policy_index_t *>(base + header.index_offset);
+  masks = reinterpret_cast<const uint64_t *>(base + header.mask_offset);
+  data = base + header.data_offset;
+  uint64_t hash = checksum(index, header.nb_infosets * sizeof(policy_index_t));
+  if (header.mask_offset)
+    hash = checksum(masks, header.nb_mask_words * sizeof(uint64_t), hash);
+  if (hash != header.index_checksum)
+    throw runtime_error("corrupt index in " + name);
+
+  if (header.mask_offset) {
+    mask_start.resize(header.nb_infosets);
+    uint64_t word = 0;
+    for (size_t i = 0; i < header.nb_infosets; ++i) {
+      mask_start[i] = word;
+      word += (index[i].nb_buckets + 63) / 64;
+    }
+  }
+}
+
+Policy::~Policy() {
+  if (mapping != MAP_FAILED)
+    munmap(mapping, mapped_bytes);
+}
+
+// renormalizes the nb_entries quantized probabilities q.
+template <class T>
+static std::vector<double> normalize(const T *q, unsigned nb_entries) {
+  std::vector<double> strategy(nb_entries);
+  double sum = 0;
+  for (unsigned i = 0; i < nb_entries; ++i)
+    sum += q[i];
+  for (unsigned i = 0; i < nb_entries; ++i)
+    strategy[i] = sum > 0 ? q[i] / sum : 1.0 / nb_entries;
+  return strategy;
+}
+
+std::vector<double> Policy::get_normalized_avg_strategy(uint64_t idx,
+                                                        int bucket) const {
+  const policy_index_t &e = index[idx];
+  uint64_t row = bucket;
+  if (!mask_start.empty()) {
+    // stored rows before bucket, or all stored rows for the fallback.
+    const uint64_t *mask = masks + mask_start[idx];
+    unsigned word = bucket / 64, nb_words = (e.nb_buckets + 63) / 64;
+    uint64_t bit = 1ULL << (bucket % 64);
+    bool stored = mask[word] & bit;
+    row = 0;
+    for (unsigned w = 0; w < (stored ? word : nb_words); ++w)
+      row += __builtin_popcountll(mask[w]);
+    if (stored)
+      row += __builtin_popcountll(mask[word] & (bit - 1));
+  }
+  uint64_t first = e.offset + row * e.nb_entries;
+  if (header.bits == 8)
+    return normalize(data + first, e.nb_entries);
+  return normalize(reinterpret_cast<const uint16_t *>(data) + first,
+                   e.nb_entries);
+}
@@ -0,0 +1,402 @@
+#include <iostream>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <boost/program_options.hpp>
+#include "cfrm.hpp"
+#include "agent_strategy.hpp"
+#include "query_protocol.hpp"
+#include "checkpoint.hpp"
+#include "functions.hpp"
+#include "main_functions.hpp"
+
+using namespace std;
+namespace ch = std::chrono;
+namespace po = boost::program_options;
+
+int parse_options(int argc, char **argv);
+void read_game(char *game_definition);
+
+struct {
+  string game_definition = "games/holdem.limit.2p.reverse_blinds.game";
+  string socket = "/tmp/cfrm-query.sock";
+
+  card_abstraction card_abs = CLUSTERCARD_ABS;
+  action_abstraction action_abs = NULLACTION_ABS;
+  string card_abs_param = "";
+  string action_abs_param = "";
+
+  string init_strategy = "";
+
+  // seconds between two reports of the counters.
+  double report_interval = 60;
+} options;
+
+// bytes of the largest batch of states the acpc parser accepts. a client
+// with more unanswered input is disconnected.
+const size_t MAX_CLIENT_INPUT =
+    sizeof(query_batch_t) + QUERY_MAX_BATCH * (sizeof(uint16_t) + MAX_LINE_LEN);
+
+// one connected client.
+struct client_t {
+  int fd;
+  // received bytes of an incomplete batch.
+  string in;
+  // responses not yet written.
+  string out;
+  bool want_write = false;
+};
+
+// counters since the start and since the last report.
+struct query_stats_t {
+  uint64_t batches = 0;
+  uint64_t queries = 0;
+  uint64_t status[4] = {0, 0, 0, 0};
+  uint64_t bytes_in = 0;
+  uint64_t bytes_out = 0;
+  // batch latencies in microseconds since the last report.
+  std::vector<double> latencies;
+};
+
+const Game *gamedef;
+AgentStrategy *agent;
+volatile sig_atomic_t stop = 0;
+
+void handle_signal(int) { stop = 1; }
+
+bool read_client(client_t &client, query_stats_t &stats);
+bool serve_client(client_t &client, query_stats_t &stats);
+void flush_client(client_t &client, int epfd);
+void answer(const char *state_str, size_t len, string &out,
+            query_stats_t &stats);
+void report(query_stats_t &stats, double seconds);
+
+int main(int argc, char **argv) {
+  if (parse_options(argc, argv) == 1)
+    return 1;
+
+  // a bundle has its own game definition.
+  if (!is_bundle(options.init_strategy))
+    read_game((char *)options.game_definition.c_str());
+  agent = load_agent(options.init_strategy, gamedef, options.card_abs,
+                     options.card_abs_param, options.action_abs,
+                     options.action_abs_param);
+
+  int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (options.socket.size() >= sizeof(addr.sun_path)) {
+    cout << "socket path " << options.socket << " is too long\n";
+    return 1;
+  }
+  strcpy(addr.sun_path, options.socket.c_str());
+  unlink(options.socket.c_str());
+  if (lfd < 0 || bind(lfd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(lfd, 128) != 0) {
+    perror(("ERROR: could not listen on " + options.socket).c_str());
+    return 1;
+  }
+  fcntl(lfd, F_SETFL, fcntl(lfd, F_GETFL) | O_NONBLOCK);
+
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  // the listening socket has the key -1, clients their fd.
+  int epfd = epoll_create1(0);
+  epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.u64 = (uint64_t)-1;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+  cout << "listening on " << options.socket << "\n";
+
+  std::map<int, client_t> clients;
+  query_stats_t stats;
+  std::vector<epoll_event> events(64);
+  auto last_report = ch::steady_clock::now();
+  while (!stop) {
+    int n = epoll_wait(epfd, events.data(), events.size(), 1000);
+    if (n < 0 && errno != EINTR) {
+      perror("ERROR: epoll_wait failed");
+      break;
+    }
+    for (int i = 0; i < n; ++i) {
+      if (events[i].data.u64 == (uint64_t)-1) {
+        int fd;
+        while ((fd = accept(lfd, NULL, NULL)) >= 0) {
+          fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+          clients[fd].fd = fd;
+          ev.events = EPOLLIN;
+          ev.data.u64 = fd;
+          epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        }
+        continue;
+      }
+
+      client_t &client = clients[events[i].data.u64];
+      if (events[i].events & EPOLLOUT)
+        flush_client(client, epfd);
+      if (!(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+        continue;
+      // a client that hung up may still have sent complete batches.
+      bool open = read_client(client, stats);
+      if (!serve_client(client, stats) || !open ||
+          client.in.size() >= MAX_CLIENT_INPUT) {
+        close(client.fd);
+        clients.erase(client.fd);
+        continue;
+      }
+      flush_client(client, epfd);
+    }
+
+    double seconds =
+        ch::duration<double>(ch::steady_clock::now() - last_report).count();
+    if (seconds >= options.report_interval) {
+      report(stats, seconds);
+      last_report = ch::steady_clock::now();
+    }
+  }
+
+  report(stats, ch::duration<double>(ch::steady_clock::now() - last_report)
+                    .count());
+  close(lfd);
+  unlink(options.socket.c_str());
+  return 0;
+}
+
+// appends what the client sent to client.in, at most up to
+// MAX_CLIENT_INPUT. the rest is read once the complete batches are answered.
+// false if the connection was closed or failed.
+bool read_client(client_t &client, query_stats_t &stats) {
+  char buf[65536];
+  while (client.in.size() < MAX_CLIENT_INPUT) {
+    ssize_t r = read(client.fd, buf, sizeof(buf));
+    if (r > 0) {
+      client.in.append(buf, r);
+      stats.bytes_in += r;
+      continue;
+    }
+    if (r < 0 && errno == EINTR)
+      continue;
+    return r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+  return true;
+}
+
+// answers the complete batches of client.in. false if a batch is malformed.
+bool serve_client(client_t &client, query_stats_t &stats) {
+  auto received = ch::steady_clock::now();
+  size_t out_before = client.out.size();
+  const char *in = client.in.data();
+  size_t start = 0, size = client.in.size();
+  while (size - start >= sizeof(query_batch_t)) {
+    query_batch_t batch;
+    memcpy(&batch, in + start, sizeof(batch));
+    if (batch.magic != QUERY_MAGIC || batch.nb_queries > QUERY_MAX_BATCH)
+      return false;
+
+    // only complete batches are answered.
+    size_t pos = start + sizeof(batch);
+    bool complete = true;
+    for (uint32_t q = 0; q < batch.nb_queries && complete; ++q) {
+      uint16_t len;
+      if (size - pos < sizeof(len)) {
+        complete = false;
+        break;
+      }
+      memcpy(&len, in + pos, sizeof(len));
+      pos += sizeof(len) + len;
+      complete = pos <= size;
+    }
+    if (!complete)
+      break;
+
+    client.out.append((const char *)&batch, sizeof(batch));
+    pos = start + sizeof(batch);
+    for (uint32_t q = 0; q < batch.nb_queries; ++q) {
+      uint16_t len;
+      memcpy(&len, in + pos, sizeof(len));
+      answer(in + pos + sizeof(len), len, client.out, stats);
+      pos += sizeof(len) + len;
+    }
+    start = pos;
+    ++stats.batches;
+    stats.queries += batch.nb_queries;
+    stats.latencies.push_back(
+        ch::duration<double, std::micro>(ch::steady_clock::now() - received)
+            .count());
+  }
+  client.in.erase(0, start);
+  stats.bytes_out += client.out.size() - out_before;
+  return true;
+}
+
+// appends the result of the query state_str to out.
+void answer(const char *state_str, size_t len, string &out,
+            query_stats_t &stats) {
+  query_result_t result = {QUERY_OK, 0};
+  char line[MAX_LINE_LEN];
+  MatchState state;
+  uint32_t node = FlatTree::NO_NODE;
+  if (len >= MAX_LINE_LEN) {
+    result.status = QUERY_BAD_STATE;
+  } else {
+    memcpy(line, state_str, len);
+    line[len] = 0;
+    if (readMatchState(line, gamedef, &state) < 0)
+      result.status = QUERY_BAD_STATE;
+    else if (stateFinished(&state.state) ||
+             currentPlayer(gamedef, &state.state) != state.viewingPlayer)
+      result.status = QUERY_NOT_ACTING;
+    else {
+      // queries are unrelated states, every lookup starts at the root. raises
+      // off the tree are translated with numbers derived from the query, so
+      // a state is always answered alike.
+      tree_cursor_t cursor;
+      nbgen rng = make_rng_stream(0, checksum(line, len));
+      node = agent->lookup(state, cursor, rng);
+      if (node == FlatTree::NO_NODE)
+        result.status = QUERY_OFF_TREE;
+    }
+  }
+  ++stats.status[result.status];
+
+  if (node == FlatTree::NO_NODE) {
+    out.append((const char *)&result, sizeof(result));
+    return;
+  }
+  std::vector<double> strategy = agent->strategy(node, state);
+  result.nb_actions = strategy.size();
+  out.append((const char *)&result, sizeof(result));
+  for (unsigned i = 0; i < strategy.size(); ++i) {
+    const Action &action = agent->action(node, i);
+    query_action_t a;
+    a.type = action.type;
+    a.size = action.type == a_raise ? action.size : 0;
+    a.probability = strategy[i];
+    out.append((const char *)&a, sizeof(a));
+  }
+}
+
+// writes as much of client.out as the socket takes and waits for the socket
+// to become writable if something is left.
+void flush_client(client_t &client, int epfd) {
+  while (!client.out.empty()) {
+    ssize_t w = write(client.fd, client.out.data(), client.out.size());
+    if (w > 0) {
+      client.out.erase(0, w);
+      continue;
+    }
+    if (w < 0 && errno == EINTR)
+      continue;
+    // a failed client is closed when epoll reports the error.
+    if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+      client.out.clear();
+    break;
+  }
+
+  bool want_write = !client.out.empty();
+  if (want_write == client.want_write)
+    return;
+  client.want_write = want_write;
+  epoll_event ev;
+  ev.events = EPOLLIN | (want_write ? (uint32_t)EPOLLOUT : (uint32_t)0);
+  ev.data.u64 = client.fd;
+  epoll_ctl(epfd, EPOLL_CTL_MOD, client.fd, &ev);
+}
+
+// prints the counters and the batch latency percentiles since the last
+// report.
+void report(query_stats_t &stats, double seconds) {
+  std::vector<double> &l = stats.latencies;
+  cout << stats.queries << " queries in " << stats.batches << " batches ("
+       << stats.status[QUERY_BAD_STATE] << " bad, "
+       << stats.status[QUERY_NOT_ACTING] << " not acting, "
+       << stats.status[QUERY_OFF_TREE] << " off tree), " << stats.bytes_in
+       << " bytes in, " << stats.bytes_out << " bytes out\n";
+  if (l.empty())
+    return;
+  std::sort(l.begin(), l.end());
+  auto percentile = [&](double p) {
+    return l[std::min<size_t>(l.size() - 1, p * l.size())];
+  };
+  cout << l.size() / seconds << " batches/s, batch latency in us: p50 "
+       << percentile(0.5) << " p90 " << percentile(0.9) << " p99 "
+       << percentile(0.99) << " max " << l.back() << "\n";
+  l.clear();
+}
+
+int parse_options(int argc, char **argv) {
+  try {
+    po::options_description desc("Allowed options");
+    desc.add_options()("help,h", "produce help message")(
+        "card-abstraction,c", po::value<string>(),
+        "set card abstraction to use")("action-abstraction,a",
+                                       po::value<string>(),
+                                       "set action abstraction to use")(
+        "action-abstraction-param,n",
+        po::value<string>(&options.action_abs_param),
+        "parameter passed to the action abstraction.")(
+        "card-abs-param,m", po::value<string>(&options.card_abs_param),
+        "parameter for card abstraction")(
+        "init-stategy,i", po::value<string>(&options.init_strategy),
+        "bundle, checkpoint or policy to answer queries with")(
+        "gamedef,g", po::value<string>(&options.game_definition),
+        "gamedefinition to use")(
+        "socket,s", po::value<string>(&options.socket),
+        "path of the unix socket to listen on")(
+        "report-interval", po::value<double>(&options.report_interval),
+        "seconds between two reports of the counters");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("card-abstraction")) {
+      string ca = vm["card-abstraction"].as<string>();
+      if (ca == "null")
+        options.card_abs = NULLCARD_ABS;
+      else if (ca == "cluster")
+        options.card_abs = CLUSTERCARD_ABS;
+    }
+
+    if (vm.count("action-abstraction")) {
+      string ca = vm["action-abstraction"].as<string>();
+      if (ca == "null")
+        options.action_abs = NULLACTION_ABS;
+      else if (ca == "potrel")
+        options.action_abs = POTRELACTION_ABS;
+    }
+
+    if (vm.count("help")) {
+      cout << desc << "\n";
+      return 1;
+    }
+  }
+  catch (exception &e) {
+    cout << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+void read_game(char *game_definition) {
+  FILE *file = fopen(game_definition, "r");
+  if (file == NULL) {
+    std::cout << "could not read game file\n";
+    exit(-1);
+  }
+  gamedef = readGame(file);
+  if (gamedef == NULL) {
+    std::cout << "could not parse game file\n";
+    exit(-1);
+  }
+}
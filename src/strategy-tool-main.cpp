@@ -0,0 +1,221 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include "definitions.hpp"
+#include "checkpoint.hpp"
+#include "policy.hpp"
+#include "bundle.hpp"
+
+using std::cout;
+using std::string;
+
+namespace ch = std::chrono;
+
+int usage() {
+  cout << "usage: strategy-tool <command> <args>\n"
+       << "  convert <dump> <checkpoint>  convert a strategy in the old dump "
+          "format\n"
+       << "  compress <checkpoint> <out> [float]\n"
+       << "                               write a compressed checkpoint, with "
+          "float the values are cut to floats\n"
+       << "  decompress <in> <checkpoint> write a compressed checkpoint as a "
+          "mapped checkpoint\n"
+       << "  export <checkpoint> <policy> [8|16]\n"
+       << "                               write the average strategy "
+          "quantized to 8 (default) or 16 bits\n"
+       << "  info <file>                  print the header of a checkpoint, "
+          "policy or bundle\n"
+       << "  verify <file>                check the data checksum of a "
+          "checkpoint, policy or bundle\n"
+       << "  compact <manifest> <checkpoint>\n"
+       << "                               apply the deltas of a manifest to "
+          "its base\n";
+  return 1;
+}
+
+int convert(const string &from, const string &to) {
+  entry_c regrets, avg_strategy;
+  auto start = ch::steady_clock::now();
+  read_legacy_dump(from, regrets, avg_strategy);
+  cout << "read " << regrets.size() << " information sets from " << from
+       << " in "
+       << ch::duration<double>(ch::steady_clock::now() - start).count()
+       << "s\n";
+
+  start = ch::steady_clock::now();
+  write_checkpoint(to, regrets, avg_strategy);
+  cout << "wrote " << to << " in "
+       << ch::duration<double>(ch::steady_clock::now() - start).count()
+       << "s\n";
+  return 0;
+}
+
+// reads any checkpoint and writes it compressed or, without compression, as
+// a mapped checkpoint.
+int recode(const string &from, const string &to, compression_t compression) {
+  entry_c regrets, avg_strategy;
+  auto start = ch::steady_clock::now();
+  read_checkpoint(from, regrets, avg_strategy, checkpoint_fingerprint(from));
+  cout << "read " << regrets.size() << " information sets from " << from
+       << " in "
+       << ch::duration<double>(ch::steady_clock::now() - start).count()
+       << "s\n";
+
+  start = ch::steady_clock::now();
+  if (compression == NO_COMPRESSION)
+    write_checkpoint(to, regrets, avg_strategy);
+  else
+    write_compressed_checkpoint(to, regrets, avg_strategy,
+                                compression == FLOAT_COMPRESSION);
+  cout << "wrote " << to << " in "
+       << ch::duration<double>(ch::steady_clock::now() - start).count()
+       << "s\n";
+  return 0;
+}
+
+int export_policy(const string &from, const string &to, unsigned bits) {
+  entry_c regrets, avg_strategy;
+  auto start = ch::steady_clock::now();
+  read_checkpoint(from, regrets, avg_strategy, checkpoint_fingerprint(from));
+  cout << "read " << regrets.size() << " information sets from " << from
+       << " in "
+       << ch::duration<double>(ch::steady_clock::now() - start).count()
+       << "s\n";
+
+  start = ch::steady_clock::now();
+  write_policy(to, avg_strategy, bits);
+  cout << "wrote " << to << " in "
+       << ch::duration<double>(ch::steady_clock::now() - start).count()
+       << "s\n";
+  return 0;
+}
+
+int policy_info(const string &filename) {
+  policy_header_t header = read_policy_header(filename);
+  cout << "policy version: " << header.version << "\n"
+       << "bits per probability: " << header.bits << "\n"
+       << "fingerprint: " << std::hex << header.fingerprint << std::dec << "\n"
+       << "information sets: " << header.nb_infosets << "\n"
+       << "probabilities: " << header.nb_values << "\n";
+  return 0;
+}
+
+int bundle_info(const string &filename) {
+  Bundle bundle(filename);
+  const bundle_header_t &header = bundle.get_header();
+  cout << "bundle version: " << header.version << "\n"
+       << "card abstraction: " << card_abstraction_str[header.card_abs] << " "
+       << header.card_abs_param << "\n"
+       << "fingerprint: " << std::hex << header.fingerprint << std::dec << "\n"
+       << "rounds: " << (int)header.game.numRounds << "\n"
+       << "nodes: " << header.nb_nodes << "\n"
+       << "sequence index slots: " << header.nb_sequence_slots << "\n";
+  for (int r = 0; r < header.game.numRounds; ++r)
+    if (header.table_size[r] > 0)
+      cout << "round " << r << " bucket table: " << header.table_size[r]
+           << " hands in " << header.nb_buckets[r] << " buckets\n";
+  cout << "policy: " << bundle.policy().get_bits() << " bits, "
+       << header.policy_bytes << " bytes\n";
+  return 0;
+}
+
+int compressed_info(const string &filename) {
+  compressed_header_t header = read_compressed_header(filename);
+  std::ifstream file(filename.c_str(), std::ios::binary | std::ios::ate);
+  uint64_t raw = 2 * header.nb_values * header.value_size;
+  cout << "compressed version: " << header.version << "\n"
+       << "value type: " << (header.value_size == 4 ? "float" : "double")
+       << "\n"
+       << "fingerprint: " << std::hex << header.fingerprint << std::dec << "\n"
+       << "information sets: " << header.nb_infosets << "\n"
+       << "values per store: " << header.nb_values << "\n"
+       << "chunks per store: " << header.nb_chunks << " of "
+       << header.chunk_values << " values\n"
+       << "compression ratio: " << raw / (double)file.tellg() << "\n";
+  return 0;
+}
+
+int info(const string &filename) {
+  if (is_compressed_checkpoint(filename))
+    return compressed_info(filename);
+  if (is_policy(filename))
+    return policy_info(filename);
+  if (is_bundle(filename))
+    return bundle_info(filename);
+  checkpoint_header_t header = read_checkpoint_header(filename);
+  cout << "version: " << header.version << "\n"
+       << "value type: " << (header.value_size == 4 ? "float" : "double")
+       << "\n"
+       << "fingerprint: " << std::hex << header.fingerprint << std::dec << "\n"
+       << "information sets: " << header.nb_infosets << "\n"
+       << "values per store: " << header.nb_values << "\n"
+       << "index offset: " << header.index_offset << "\n"
+       << "regrets offset: " << header.regrets_offset << "\n"
+       << "average strategy offset: " << header.avg_offset << "\n";
+  return 0;
+}
+
+int verify(const string &filename) {
+  bool ok = is_bundle(filename)   ? Bundle(filename).verify()
+            : is_policy(filename) ? verify_policy(filename)
+                                  : verify_checkpoint(filename);
+  if (ok) {
+    cout << filename << ": ok\n";
+    return 0;
+  }
+  cout << filename << ": checksum mismatch\n";
+  return 1;
+}
+
+int compact(const string &manifest, const string &to) {
+  std::vector<string> files = read_manifest(manifest);
+  auto start = ch::steady_clock::now();
+  entry_c regrets, avg_strategy;
+  read_checkpoint(files[0], regrets, avg_strategy,
+                  checkpoint_fingerprint(files[0]));
+  for (size_t i = 1; i < files.size(); ++i)
+    apply_delta(files[i], regrets, avg_strategy);
+  cout << "applied " << files.size() - 1 << " deltas to " << files[0]
+       << " in "
+       << ch::duration<double>(ch::steady_clock::now() - start).count()
+       << "s\n";
+
+  start = ch::steady_clock::now();
+  write_checkpoint(to, regrets, avg_strategy);
+  cout << "wrote " << to << " in "
+       << ch::duration<double>(ch::steady_clock::now() - start).count()
+       << "s\n";
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3)
+    return usage();
+  string command = argv[1];
+
+  try {
+    if (command == "convert" && argc == 4)
+      return convert(argv[2], argv[3]);
+    if (command == "compress" && (argc == 4 || argc == 5)) {
+      if (argc == 5 && string(argv[4]) != "float")
+        return usage();
+      return recode(argv[2], argv[3],
+                    argc == 5 ? FLOAT_COMPRESSION : LOSSLESS_COMPRESSION);
+    }
+    if (command == "decompress" && argc == 4)
+      return recode(argv[2], argv[3], NO_COMPRESSION);
+    if (command == "export" && (argc == 4 || argc == 5))
+      return export_policy(argv[2], argv[3], argc == 5 ? atoi(argv[4]) : 8);
+    if (command == "info" && argc == 3)
+      return info(argv[2]);
+    if (command == "verify" && argc == 3)
+      return verify(argv[2]);
+    if (command == "compact" && argc == 4)
+      return compact(argv[2], argv[3]);
+  } catch (std::exception &e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+  return usage();
+}